@@ -0,0 +1,275 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "menu.h"
+#include "utils.h"
+#include "autoboot.h"
+#include "variables.h"
+
+#define LAST_BOOTED_VARIABLE L"Enterprise_LastBooted"
+#define NEXT_BOOT_VARIABLE L"Enterprise_NextBoot"
+#define DEFAULT_BOOT_VARIABLE L"Enterprise_DefaultBoot"
+#define ENTRY_NAME_MAX 256
+
+typedef enum {
+	AUTOBOOT_NUMBER,
+	AUTOBOOT_NAME,
+	AUTOBOOT_LAST
+} AutobootChoice;
+
+static AutobootChoice autoboot_choice = AUTOBOOT_NUMBER;
+static UINTN autoboot_number = 0;
+static CHAR8 *autoboot_name = NULL;
+static UINTN autoboot_timeout = 0;
+static BOOLEAN autoboot_timeout_set = FALSE;
+
+// Entries picked by a hardware profile alone wait this long, so that the menu can still be reached.
+#define HARDWARE_AUTOBOOT_TIMEOUT 5
+
+/*
+ * The entries by name, in an open addressing table with at least twice as many slots as
+ * there are entries. Empty slots have no option.
+ */
+typedef struct {
+	LinuxBootOption *option;
+	UINTN position;
+} NameTableSlot;
+
+static NameTableSlot *name_table = NULL;
+static UINTN name_table_size = 0;
+
+/*
+ * Sets the entry to boot from the value of the autoboot key: a single digit for the
+ * entry's number, counting from zero, "last" for the entry booted last time, or the name
+ * of an entry. Returns FALSE if the value is empty or can't be stored.
+ */
+BOOLEAN SetAutobootEntry(CHAR8 *value) {
+	if (!value || !*value) {
+		return FALSE;
+	}
+	
+	if (strlena(value) == 1 && *value >= '0' && *value <= '9') {
+		autoboot_choice = AUTOBOOT_NUMBER;
+		autoboot_number = *value - '0';
+	} else if (strcmpa((CHAR8 *)"last", value) == 0) {
+		autoboot_choice = AUTOBOOT_LAST;
+	} else {
+		if (autoboot_name) {
+			FreePool(autoboot_name);
+		}
+		autoboot_name = AllocatePool(strlena(value) + 1);
+		if (!autoboot_name) {
+			return FALSE;
+		}
+		strcpya(autoboot_name, value);
+		autoboot_choice = AUTOBOOT_NAME;
+	}
+	
+	return TRUE;
+}
+
+/* Sets how many seconds the user has to interrupt the boot. Zero boots right away. */
+VOID SetAutobootTimeout(UINTN seconds) {
+	autoboot_timeout = seconds;
+	autoboot_timeout_set = TRUE;
+}
+
+/* Indexes the entries by name. Entries with the same name as an earlier one are left out. */
+static VOID BuildNameTable(VOID) {
+	BootableLinuxDistro *conductor;
+	UINTN count = 0, position, slot;
+	
+	for (conductor = distributionListRoot->next; conductor; conductor = conductor->next) {
+		count++;
+	}
+	
+	for (name_table_size = 8; name_table_size < count * 2; name_table_size *= 2);
+	name_table = AllocateZeroPool(name_table_size * sizeof(NameTableSlot));
+	if (!name_table) {
+		return;
+	}
+	
+	for (position = 0, conductor = distributionListRoot->next; conductor; conductor = conductor->next, position++) {
+		CHAR8 *name = conductor->bootOption->name;
+		if (!name) {
+			continue;
+		}
+		
+		slot = HashBytes(name, strlena(name), HASH_INITIAL_VALUE) & (name_table_size - 1);
+		while (name_table[slot].option && strcmpa(name_table[slot].option->name, name) != 0) {
+			slot = (slot + 1) & (name_table_size - 1);
+		}
+		
+		if (!name_table[slot].option) {
+			name_table[slot].option = conductor->bootOption;
+			name_table[slot].position = position;
+		}
+	}
+}
+
+/* Returns the position of the entry with the given name, counting from zero, or -1. */
+INTN FindEntryByName(CHAR8 *name) {
+	UINTN slot;
+	
+	if (!distributionListRoot || !name) {
+		return -1;
+	}
+	
+	if (!name_table) {
+		BuildNameTable();
+		if (!name_table) {
+			return -1;
+		}
+	}
+	
+	slot = HashBytes(name, strlena(name), HASH_INITIAL_VALUE) & (name_table_size - 1);
+	while (name_table[slot].option) {
+		if (strcmpa(name_table[slot].option->name, name) == 0) {
+			return name_table[slot].position;
+		}
+		slot = (slot + 1) & (name_table_size - 1);
+	}
+	
+	return -1;
+}
+
+/*
+ * Returns the position of the entry named by the given variable, or -1. The variables can
+ * be written from Linux through efivarfs, so the name doesn't have to be terminated, and
+ * a line break after it is ignored.
+ */
+static INTN EntryNamedByVariable(CHAR16 *variable) {
+	CHAR8 *value, name[ENTRY_NAME_MAX];
+	UINTN size;
+	
+	if (EFI_ERROR(VariableGet(&enterprise_variable_guid, variable, &value, &size)) || size >= ENTRY_NAME_MAX) {
+		return -1;
+	}
+	
+	CopyMem(name, value, size);
+	while (size > 0 && (name[size - 1] == '\0' || name[size - 1] == '\n' || name[size - 1] == '\r')) {
+		size--;
+	}
+	name[size] = '\0';
+	
+	return size > 0 ? FindEntryByName(name) : -1;
+}
+
+/*
+ * Returns the position of the entry to boot, or -1 if there is no such entry. An entry
+ * named by the default variable comes first, then the entry meant for this machine, if
+ * any; otherwise the autoboot key decides, if the configuration file has one.
+ */
+INTN AutobootEntryIndex(BOOLEAN configured, INTN hardware_index) {
+	INTN index = EntryNamedByVariable(DEFAULT_BOOT_VARIABLE);
+	
+	if (index >= 0) {
+		return index;
+	} else if (hardware_index >= 0 || !configured) {
+		// Without any autoboot settings, there has to be a chance to get to the menu.
+		if (hardware_index >= 0 && !configured && !autoboot_timeout_set) {
+			autoboot_timeout = HARDWARE_AUTOBOOT_TIMEOUT;
+		}
+		return hardware_index;
+	}
+	
+	switch (autoboot_choice) {
+		case AUTOBOOT_NUMBER:
+			return BootOptionAtIndex(autoboot_number) ? (INTN)autoboot_number : -1;
+		case AUTOBOOT_NAME:
+			return FindEntryByName(autoboot_name);
+		case AUTOBOOT_LAST:
+			return EntryNamedByVariable(LAST_BOOTED_VARIABLE);
+	}
+	
+	return -1;
+}
+
+/* Returns TRUE if an entry has been picked for this boot only. */
+BOOLEAN NextBootRequested(VOID) {
+	CHAR8 *value;
+	UINTN size;
+	
+	return !EFI_ERROR(VariableGet(&enterprise_variable_guid, NEXT_BOOT_VARIABLE, &value, &size));
+}
+
+/*
+ * Returns the position of the entry picked for this boot only, or -1, and forgets it. It
+ * is deleted right away, so that an entry that doesn't boot can't be tried over and over.
+ */
+INTN TakeNextBootEntry(VOID) {
+	INTN index = EntryNamedByVariable(NEXT_BOOT_VARIABLE);
+	
+	VariableDelete(&enterprise_variable_guid, NEXT_BOOT_VARIABLE);
+	VariableFlush();
+	return index;
+}
+
+/*
+ * Counts down the timeout on the console. Returns TRUE if it ran out, or FALSE if the
+ * user pressed a key to get to the menu instead.
+ */
+BOOLEAN AutobootCountdown(UINTN index) {
+	EFI_STATUS err;
+	EFI_EVENT timer;
+	LinuxBootOption *option = BootOptionAtIndex(index);
+	UINTN remaining = autoboot_timeout;
+	UINT64 key;
+	
+	// Don't hold up unattended boots at all.
+	if (remaining == 0) {
+		return TRUE;
+	}
+	
+	err = uefi_call_wrapper(BS->CreateEvent, 5, EVT_TIMER, 0, NULL, NULL, &timer);
+	if (EFI_ERROR(err)) {
+		return TRUE;
+	}
+	uefi_call_wrapper(BS->SetTimer, 3, timer, TimerPeriodic, 10 * 1000 * 1000);
+	
+	while (remaining > 0) {
+		Print(L"\rBooting %a in %d seconds, press any key for the menu. ", option->name, remaining);
+		
+		// The timer ticks once a second; a key press ends the countdown.
+		err = key_read_or_event(&key, timer);
+		if (err == EFI_NOT_READY) {
+			remaining--;
+		} else if (EFI_ERROR(err)) {
+			// Without a keyboard, nobody can interrupt the boot anyway.
+			remaining = 0;
+		} else {
+			break;
+		}
+	}
+	
+	uefi_call_wrapper(BS->SetTimer, 3, timer, TimerCancel, 0);
+	uefi_call_wrapper(BS->CloseEvent, 1, timer);
+	Print(L"\n");
+	return remaining == 0;
+}
+
+/* Remembers the entry about to be booted, for autoboot last. */
+VOID RememberBootedEntry(LinuxBootOption *option) {
+	if (option->name) {
+		VariableSet(&enterprise_variable_guid, LAST_BOOTED_VARIABLE, option->name, strlena(option->name) + 1, TRUE);
+	}
+}
@@ -0,0 +1,42 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _autoboot_h
+#define _autoboot_h
+#include "main.h"
+
+/*
+ * Picks the entry to boot without showing the menu. The entry can be given by its number,
+ * by its name, or as the one booted last time, which is remembered in a variable. If a
+ * timeout is set, the boot can be interrupted with any key until it runs out.
+ *
+ * The running system can also name an entry in the Enterprise_DefaultBoot variable, which
+ * takes the place of the autoboot key, or in Enterprise_NextBoot, for the next boot only.
+ */
+BOOLEAN SetAutobootEntry(CHAR8 *);
+VOID SetAutobootTimeout(UINTN);
+INTN AutobootEntryIndex(BOOLEAN, INTN);
+BOOLEAN NextBootRequested(VOID);
+INTN TakeNextBootEntry(VOID);
+BOOLEAN AutobootCountdown(UINTN);
+INTN FindEntryByName(CHAR8 *);
+VOID RememberBootedEntry(LinuxBootOption *);
+
+#endif
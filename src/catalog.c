@@ -0,0 +1,271 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "catalog.h"
+#include "iso9660.h"
+#include "volumes.h"
+
+/* Packs a file time into a number of the form YYYYMMDDhhmmss. */
+UINT64 PackFileTime(EFI_TIME *time) {
+	return ((((((UINT64)time->Year * 100 + time->Month) * 100 + time->Day) * 100 +
+		time->Hour) * 100 + time->Minute) * 100) + time->Second;
+}
+
+static UINT64 ParseNumber(CHAR8 **string) {
+	UINT64 number = 0;
+	CHAR8 *p = *string;
+	
+	while (*p == ' ' || *p == '\t') {
+		p++;
+	}
+	
+	while (*p >= '0' && *p <= '9') {
+		number = number * 10 + (*p++ - '0');
+	}
+	
+	*string = p;
+	return number;
+}
+
+static VOID ParseRange(CHAR8 *value, FileRange *range) {
+	range->offset = ParseNumber(&value);
+	range->length = ParseNumber(&value);
+}
+
+/* Catalog paths are compared ignoring case and the kind of path separator. */
+static UINT64 HashPath(CHAR8 *path) {
+	UINT64 hash = HASH_INITIAL_VALUE;
+	
+	for (; *path; path++) {
+		CHAR8 c = *path == '\\' ? '/' : *path;
+		if (c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+		hash = HashBytes(&c, 1, hash);
+	}
+	
+	return hash;
+}
+
+static BOOLEAN PathsEqual(CHAR8 *a, CHAR8 *b) {
+	for (; *a && *b; a++, b++) {
+		CHAR8 x = *a == '\\' ? '/' : *a, y = *b == '\\' ? '/' : *b;
+		if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+		if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+		if (x != y) {
+			return FALSE;
+		}
+	}
+	
+	return *a == *b;
+}
+
+/* Reads and indexes the catalog of a volume, if it has one. This happens only once. */
+static VOID LoadBootCatalog(Volume *volume) {
+	CHAR8 *contents, *key, *value;
+	CatalogEntry *entry = NULL;
+	UINTN position = 0;
+	
+	volume->catalog_loaded = TRUE;
+	if (FileRead(volume->root, BOOT_CATALOG_PATH, &contents) == 0) {
+		return;
+	}
+	
+	volume->catalog = AllocateZeroPool(sizeof(CatalogEntry *) * BOOT_CATALOG_BUCKETS);
+	if (!volume->catalog) {
+		FreePool(contents);
+		return;
+	}
+	
+	while (GetConfigurationKeyAndValue(contents, &position, &key, &value)) {
+		if (strcmpa((CHAR8 *)"iso", key) == 0) {
+			entry = AllocateZeroPool(sizeof(CatalogEntry));
+			if (!entry) {
+				goto out;
+			}
+			
+			entry->iso_path = AllocatePool(strlena(value) + 1);
+			if (!entry->iso_path) {
+				FreePool(entry);
+				goto out;
+			}
+			strcpya(entry->iso_path, value);
+			UINTN bucket = HashPath(entry->iso_path) % BOOT_CATALOG_BUCKETS;
+			entry->next = volume->catalog[bucket];
+			volume->catalog[bucket] = entry;
+		} else if (!entry) {
+			// Everything else describes the ISO file named before it.
+			continue;
+		} else if (strcmpa((CHAR8 *)"size", key) == 0) {
+			entry->iso_size = ParseNumber(&value);
+		} else if (strcmpa((CHAR8 *)"mtime", key) == 0) {
+			entry->iso_mtime = ParseNumber(&value);
+		} else if (strcmpa((CHAR8 *)"kernel", key) == 0) {
+			ParseRange(value, &entry->kernel);
+		} else if (strcmpa((CHAR8 *)"initrd", key) == 0) {
+			ParseRange(value, &entry->initrd);
+		} else if (strcmpa((CHAR8 *)"cmdline", key) == 0) {
+			// An entry without a command line is still usable.
+			if (entry->cmdline) {
+				FreePool(entry->cmdline);
+			}
+			entry->cmdline = AllocatePool(strlena(value) + 1);
+			if (!entry->cmdline) {
+				goto out;
+			}
+			strcpya(entry->cmdline, value);
+		}
+	}
+	
+out:
+	FreePool(contents);
+}
+
+/*
+ * Returns the catalog block for the entry's ISO file, or NULL if there is none or the
+ * ISO file has changed since the catalog was written.
+ */
+CatalogEntry* LookupBootCatalog(LinuxBootOption *option) {
+	Volume *volume = option->volume;
+	CatalogEntry *entry;
+	EFI_FILE_INFO info;
+	EFI_STATUS err;
+	CHAR16 *path;
+	
+	if (!volume) {
+		return NULL;
+	}
+	
+	if (!volume->catalog_loaded) {
+		LoadBootCatalog(volume);
+	}
+	
+	if (!volume->catalog) {
+		return NULL;
+	}
+	
+	entry = volume->catalog[HashPath(option->iso_path) % BOOT_CATALOG_BUCKETS];
+	while (entry && !PathsEqual(entry->iso_path, option->iso_path)) {
+		entry = entry->next;
+	}
+	
+	if (!entry) {
+		return NULL;
+	}
+	
+	// Make sure that the offsets are still correct.
+	path = GRUBPathToEFIPath(option->iso_path);
+	err = FileCacheGetInfo(volume->root, path, &info);
+	FreePool(path);
+	
+	if (EFI_ERROR(err) || info.FileSize != entry->iso_size || PackFileTime(&info.ModificationTime) != entry->iso_mtime) {
+		return NULL;
+	}
+	
+	return entry;
+}
+
+/*
+ * Finds the kernel and initrd of an entry inside its ISO file. The catalog answers this
+ * with a single lookup; without it we have to walk the ISO's directories.
+ */
+EFI_STATUS LocateBootFiles(LinuxBootOption *option, OUT BootFileLocation *location) {
+	CatalogEntry *entry = LookupBootCatalog(option);
+	EFI_FILE_HANDLE iso;
+	EFI_FILE_INFO info;
+	EFI_STATUS err;
+	CHAR16 *path;
+	
+	SetMem(location, sizeof(BootFileLocation), 0);
+	if (entry) {
+		location->kernel = entry->kernel;
+		location->initrd = entry->initrd;
+		location->cmdline = entry->cmdline;
+		location->iso_size = entry->iso_size;
+		location->iso_mtime = entry->iso_mtime;
+		return EFI_SUCCESS;
+	}
+	
+	if (!option->volume || !option->kernel_path || !option->initrd_path) {
+		return EFI_NOT_FOUND;
+	}
+	
+	path = GRUBPathToEFIPath(option->iso_path);
+	err = FileCacheGetInfo(option->volume->root, path, &info);
+	if (!EFI_ERROR(err)) {
+		err = FileCacheOpen(option->volume->root, path, &iso);
+	}
+	FreePool(path);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	location->iso_size = info.FileSize;
+	location->iso_mtime = PackFileTime(&info.ModificationTime);
+	
+	err = ISO9660FindFile(iso, option->kernel_path, &location->kernel.offset, &location->kernel.length);
+	if (!EFI_ERROR(err)) {
+		err = ISO9660FindFile(iso, option->initrd_path, &location->initrd.offset, &location->initrd.length);
+	}
+	
+	uefi_call_wrapper(iso->Close, 1, iso);
+	return err;
+}
+
+/* Reads a byte range of the entry's ISO file straight into the destination buffer. */
+EFI_STATUS ReadBootFile(LinuxBootOption *option, FileRange *range, VOID *destination) {
+	EFI_FILE_HANDLE iso;
+	EFI_STATUS err;
+	CHAR16 *path;
+	CHAR8 *dest = destination;
+	UINT64 remaining = range->length;
+	
+	if (!option->volume) {
+		return EFI_NOT_FOUND;
+	}
+	
+	path = GRUBPathToEFIPath(option->iso_path);
+	err = FileCacheOpen(option->volume->root, path, &iso);
+	FreePool(path);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	err = uefi_call_wrapper(iso->SetPosition, 2, iso, range->offset);
+	
+	// Some firmware can't read very large amounts at once.
+	while (!EFI_ERROR(err) && remaining > 0) {
+		UINTN read_size = remaining < FILE_STREAM_DEFAULT_CHUNK_SIZE ? (UINTN)remaining : FILE_STREAM_DEFAULT_CHUNK_SIZE;
+		
+		err = uefi_call_wrapper(iso->Read, 3, iso, &read_size, dest);
+		if (!EFI_ERROR(err) && read_size == 0) {
+			err = EFI_VOLUME_CORRUPTED;
+		}
+		
+		dest += read_size;
+		remaining -= read_size;
+	}
+	
+	uefi_call_wrapper(iso->Close, 1, iso);
+	return err;
+}
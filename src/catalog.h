@@ -0,0 +1,73 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _catalog_h
+#define _catalog_h
+#include "main.h"
+
+/*
+ * The boot catalog lists where the kernel and initrd of each ISO file are stored inside
+ * it, so that they can be read without walking the ISO 9660 directories. It lives next
+ * to the configuration file and uses the same format, with one block per ISO file:
+ *
+ *     iso /isos/ubuntu-14.04-desktop-amd64.iso
+ *     size 1010827264
+ *     mtime 20140417093000
+ *     kernel 1136640 5823136
+ *     initrd 6961152 20988463
+ *     cmdline boot=casper quiet splash
+ *
+ * kernel and initrd give a byte offset and a length within the ISO file. size and mtime
+ * (YYYYMMDDhhmmss) describe the ISO file the offsets were taken from; if the file on
+ * disk doesn't match them anymore, the block is ignored.
+ */
+#define BOOT_CATALOG_PATH L"\\efi\\boot\\enterprise.cat"
+#define BOOT_CATALOG_BUCKETS 32
+
+typedef struct FileRange {
+	UINT64 offset;
+	UINT64 length;
+} FileRange;
+
+typedef struct CatalogEntry {
+	CHAR8 *iso_path;
+	UINT64 iso_size;
+	UINT64 iso_mtime;
+	FileRange kernel;
+	FileRange initrd;
+	CHAR8 *cmdline;
+	struct CatalogEntry *next;
+} CatalogEntry;
+
+/* Where the kernel and initrd of an entry are stored inside its ISO file. */
+typedef struct BootFileLocation {
+	FileRange kernel;
+	FileRange initrd;
+	CHAR8 *cmdline; // NULL unless the catalog gives one.
+	UINT64 iso_size;
+	UINT64 iso_mtime;
+} BootFileLocation;
+
+UINT64 PackFileTime(EFI_TIME *);
+CatalogEntry* LookupBootCatalog(LinuxBootOption *);
+EFI_STATUS LocateBootFiles(LinuxBootOption *, OUT BootFileLocation *);
+EFI_STATUS ReadBootFile(LinuxBootOption *, FileRange *, VOID *);
+
+#endif
@@ -42,3 +42,46 @@ CHAR8* InitRDLocationForDistributionName(CHAR8 *name) {
 		return (CHAR8 *)"";
 	}
 }
+
+/*
+ * Returns the kernel parameter that tells the distribution's live system which ISO file
+ * to mount once it's running, for when the kernel isn't started by GRUB.
+ */
+CHAR8* ISOScanParameterForDistributionName(CHAR8 *name) {
+	if (strcmpa((CHAR8 *)"Debian", name) == 0) {
+		return (CHAR8 *)"findiso=";
+	} else if (strcmpa((CHAR8 *)"Ubuntu", name) == 0) {
+		return (CHAR8 *)"iso-scan/filename=";
+	} else {
+		return (CHAR8 *)"";
+	}
+}
+
+/* Returns TRUE if needle occurs anywhere in haystack, ignoring the case of ASCII letters. */
+static BOOLEAN ContainsIgnoringCase(CHAR8 *haystack, CHAR8 *needle) {
+	UINTN i;
+	
+	for (; *haystack; haystack++) {
+		for (i = 0; needle[i] && (haystack[i] | 0x20) == (needle[i] | 0x20); i++);
+		if (!needle[i]) {
+			return TRUE;
+		}
+	}
+	
+	return FALSE;
+}
+
+/*
+ * Guesses the distribution family of an ISO file from its name, for ISO files that
+ * were found on disk rather than listed in a configuration file. Returns NULL if the
+ * name doesn't give it away.
+ */
+CHAR8* DistributionFamilyForFileName(CHAR8 *file_name) {
+	if (ContainsIgnoringCase(file_name, (CHAR8 *)"ubuntu")) {
+		return (CHAR8 *)"Ubuntu";
+	} else if (ContainsIgnoringCase(file_name, (CHAR8 *)"debian")) {
+		return (CHAR8 *)"Debian";
+	} else {
+		return NULL;
+	}
+}
@@ -24,5 +24,7 @@
 
 CHAR8* KernelLocationForDistributionName(CHAR8 *, OUT CHAR8 **);
 CHAR8* InitRDLocationForDistributionName(CHAR8 *);
+CHAR8* ISOScanParameterForDistributionName(CHAR8 *);
+CHAR8* DistributionFamilyForFileName(CHAR8 *);
 
 #endif
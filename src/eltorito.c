@@ -0,0 +1,234 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "catalog.h"
+#include "eltorito.h"
+#include "iso9660.h"
+#include "validation.h"
+#include "variables.h"
+#include "volumes.h"
+
+#ifdef __x86_64__
+	#define ELTORITO_LOADER_PATH L"\\EFI\\BOOT\\BOOTX64.EFI"
+#else
+	#define ELTORITO_LOADER_PATH L"\\EFI\\BOOT\\BOOTIA32.EFI"
+#endif
+
+#define RAM_DISK_BLOCK_SIZE 512
+
+/* Identifies our in-memory disks in their device paths. */
+static EFI_GUID ram_disk_guid = {0x5a3b7e0c, 0x1d4f, 0x4c2e, {0x9a, 0x61, 0x3e, 0x8b, 0x27, 0xd0, 0x4f, 0x15}};
+
+/* A read-only disk backed by a buffer. The Block I/O protocol has to come first. */
+typedef struct {
+	EFI_BLOCK_IO block_io;
+	EFI_BLOCK_IO_MEDIA media;
+	struct {
+		VENDOR_DEVICE_PATH vendor;
+		EFI_DEVICE_PATH end;
+	} __attribute__((packed)) device_path;
+	EFI_HANDLE handle;
+	UINT8 *data;
+} RamDisk;
+
+static EFI_STATUS EFIAPI RamDiskReset(EFI_BLOCK_IO *This, BOOLEAN ExtendedVerification) {
+	(void)This;
+	(void)ExtendedVerification;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI RamDiskReadBlocks(EFI_BLOCK_IO *This, UINT32 MediaId, EFI_LBA Lba, UINTN BufferSize, VOID *Buffer) {
+	RamDisk *disk = (RamDisk *)This;
+	
+	if (MediaId != disk->media.MediaId) {
+		return EFI_MEDIA_CHANGED;
+	}
+	if (BufferSize % RAM_DISK_BLOCK_SIZE != 0) {
+		return EFI_BAD_BUFFER_SIZE;
+	}
+	if (Lba > disk->media.LastBlock || BufferSize / RAM_DISK_BLOCK_SIZE > disk->media.LastBlock - Lba + 1) {
+		return EFI_INVALID_PARAMETER;
+	}
+	
+	CopyMem(Buffer, disk->data + Lba * RAM_DISK_BLOCK_SIZE, BufferSize);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI RamDiskWriteBlocks(EFI_BLOCK_IO *This, UINT32 MediaId, EFI_LBA Lba, UINTN BufferSize, VOID *Buffer) {
+	(void)This;
+	(void)MediaId;
+	(void)Lba;
+	(void)BufferSize;
+	(void)Buffer;
+	return EFI_WRITE_PROTECTED;
+}
+
+static EFI_STATUS EFIAPI RamDiskFlushBlocks(EFI_BLOCK_IO *This) {
+	(void)This;
+	return EFI_SUCCESS;
+}
+
+/* Hands the buffer to the firmware as a disk, which its FAT driver then picks up. */
+static EFI_STATUS RamDiskCreate(UINT8 *data, UINT64 size, OUT RamDisk **out) {
+	RamDisk *disk = AllocateZeroPool(sizeof(RamDisk));
+	EFI_STATUS err;
+	
+	if (!disk) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	disk->data = data;
+	disk->media.MediaId = 1;
+	disk->media.MediaPresent = TRUE;
+	disk->media.ReadOnly = TRUE;
+	disk->media.BlockSize = RAM_DISK_BLOCK_SIZE;
+	disk->media.LastBlock = size / RAM_DISK_BLOCK_SIZE - 1;
+	disk->block_io.Revision = EFI_BLOCK_IO_INTERFACE_REVISION;
+	disk->block_io.Media = &disk->media;
+	disk->block_io.Reset = RamDiskReset;
+	disk->block_io.ReadBlocks = RamDiskReadBlocks;
+	disk->block_io.WriteBlocks = RamDiskWriteBlocks;
+	disk->block_io.FlushBlocks = RamDiskFlushBlocks;
+	
+	disk->device_path.vendor.Header.Type = HARDWARE_DEVICE_PATH;
+	disk->device_path.vendor.Header.SubType = HW_VENDOR_DP;
+	SetDevicePathNodeLength(&disk->device_path.vendor.Header, sizeof(VENDOR_DEVICE_PATH));
+	disk->device_path.vendor.Guid = ram_disk_guid;
+	SetDevicePathEndNode(&disk->device_path.end);
+	
+	err = uefi_call_wrapper(BS->InstallProtocolInterface, 4, &disk->handle, &DevicePathProtocol,
+		EFI_NATIVE_INTERFACE, &disk->device_path);
+	if (!EFI_ERROR(err)) {
+		err = uefi_call_wrapper(BS->InstallProtocolInterface, 4, &disk->handle, &BlockIoProtocol,
+			EFI_NATIVE_INTERFACE, &disk->block_io);
+		if (EFI_ERROR(err)) {
+			uefi_call_wrapper(BS->UninstallProtocolInterface, 3, disk->handle, &DevicePathProtocol, &disk->device_path);
+		}
+	}
+	if (EFI_ERROR(err)) {
+		FreePool(disk);
+		return err;
+	}
+	
+	uefi_call_wrapper(BS->ConnectController, 4, disk->handle, NULL, NULL, TRUE);
+	*out = disk;
+	return EFI_SUCCESS;
+}
+
+static VOID RamDiskDestroy(RamDisk *disk) {
+	uefi_call_wrapper(BS->DisconnectController, 3, disk->handle, NULL, NULL);
+	uefi_call_wrapper(BS->UninstallProtocolInterface, 3, disk->handle, &BlockIoProtocol, &disk->block_io);
+	uefi_call_wrapper(BS->UninstallProtocolInterface, 3, disk->handle, &DevicePathProtocol, &disk->device_path);
+	FreePool(disk);
+}
+
+/* Reads the entry's EFI boot image and starts the loader in it. Only returns if that fails. */
+EFI_STATUS BootElTorito(LinuxBootOption *option) {
+	EFI_FILE_HANDLE iso, image_root;
+	EFI_PHYSICAL_ADDRESS buffer = 0;
+	EFI_DEVICE_PATH *path = NULL;
+	EFI_HANDLE image;
+	FileRange range;
+	RamDisk *disk = NULL;
+	CHAR16 *problem = L"Error starting the loader of this ISO file";
+	CHAR8 *loader = NULL;
+	CHAR16 *iso_path;
+	UINTN pages = 0, loader_size;
+	EFI_STATUS err;
+	
+	if (!option->volume) {
+		err = EFI_NOT_FOUND;
+		goto fail;
+	}
+	
+	iso_path = GRUBPathToEFIPath(option->iso_path);
+	err = FileCacheOpen(option->volume->root, iso_path, &iso);
+	FreePool(iso_path);
+	if (!EFI_ERROR(err)) {
+		err = ISO9660FindEFIBootImage(iso, &range.offset, &range.length);
+		uefi_call_wrapper(iso->Close, 1, iso);
+		if (EFI_ERROR(err)) {
+			problem = L"Error: this ISO file has no EFI boot image";
+		}
+	}
+	if (EFI_ERROR(err)) {
+		goto fail;
+	}
+	
+	// The boot image is only a few megabytes, so it is read in one go.
+	pages = EFI_SIZE_TO_PAGES(range.length);
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, pages, &buffer);
+	if (EFI_ERROR(err)) {
+		pages = 0;
+		goto fail;
+	}
+	
+	err = ReadBootFile(option, &range, (VOID *)(UINTN)buffer);
+	if (!EFI_ERROR(err)) {
+		err = RamDiskCreate((UINT8 *)(UINTN)buffer, range.length, &disk);
+	}
+	if (EFI_ERROR(err)) {
+		goto fail;
+	}
+	
+	image_root = LibOpenRoot(disk->handle);
+	if (!image_root) {
+		err = EFI_UNSUPPORTED;
+		goto fail;
+	}
+	
+	// The directory handles cached on the way belong to a disk that goes away again.
+	StopBackgroundValidation();
+	loader_size = FileRead(image_root, ELTORITO_LOADER_PATH, &loader);
+	FileCacheFlush();
+	uefi_call_wrapper(image_root->Close, 1, image_root);
+	if (loader_size == 0) {
+		problem = L"Error: the EFI boot image of this ISO file has no loader for this machine";
+		err = EFI_NOT_FOUND;
+		goto fail;
+	}
+	
+	// The loader finds its own files relative to the disk it was loaded from.
+	path = FileDevicePath(disk->handle, ELTORITO_LOADER_PATH);
+	err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, global_image, path, loader, loader_size, &image);
+	if (EFI_ERROR(err)) {
+		goto fail;
+	}
+	
+	VariableFlush();
+	if (!headless) {
+		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
+	}
+	err = uefi_call_wrapper(BS->StartImage, 3, image, NULL, NULL);
+	
+fail:
+	if (EFI_ERROR(err)) {
+		DisplayErrorText(problem);
+		Print(L": %r\n", err);
+	}
+	if (path) FreePool(path);
+	if (loader) FreePool(loader);
+	if (disk) RamDiskDestroy(disk);
+	if (pages) uefi_call_wrapper(BS->FreePages, 2, buffer, pages);
+	return err;
+}
@@ -0,0 +1,32 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _eltorito_h
+#define _eltorito_h
+#include "main.h"
+
+/*
+ * Boots an ISO file through its own EFI loader. The El Torito EFI boot image, a small
+ * FAT file system, is read into memory and handed to the firmware as a read-only disk,
+ * and the loader in it is started from there.
+ */
+EFI_STATUS BootElTorito(LinuxBootOption *);
+
+#endif
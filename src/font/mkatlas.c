@@ -0,0 +1,123 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+/*
+ * Turns the ASCII-art glyphs in font.txt into the glyph atlas used by the graphical
+ * renderer. Each glyph is placed in a GLYPH_WIDTH by GLYPH_HEIGHT cell, which includes
+ * the spacing between characters and lines, and every row of the cell is stored as one
+ * byte with the leftmost pixel in the highest bit.
+ *
+ * usage: mkatlas < font.txt > glyphs.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOURCE_WIDTH 5
+#define SOURCE_HEIGHT 7
+
+#define GLYPH_WIDTH 6
+#define GLYPH_HEIGHT 10
+#define GLYPH_TOP 1 // Empty rows above each glyph.
+#define GLYPH_FIRST 0x20
+#define GLYPH_COUNT 95
+
+static unsigned char atlas[GLYPH_COUNT][GLYPH_HEIGHT];
+static int defined[GLYPH_COUNT];
+
+static void fail(int line, const char *message) {
+	fprintf(stderr, "mkatlas: line %d: %s\n", line, message);
+	exit(1);
+}
+
+int main(void) {
+	char line[256];
+	int line_number = 0, glyph = -1, row = 0, i, j;
+	
+	while (fgets(line, sizeof(line), stdin)) {
+		line_number++;
+		line[strcspn(line, "\r\n")] = '\0';
+		
+		if (line[0] == '#' && glyph < 0) {
+			continue; // A comment.
+		}
+		
+		if (strncmp(line, "glyph ", 6) == 0) {
+			unsigned long code = strtoul(line + 6, NULL, 16);
+			if (glyph >= 0) {
+				fail(line_number, "previous glyph is incomplete");
+			}
+			if (code < GLYPH_FIRST || code >= GLYPH_FIRST + GLYPH_COUNT) {
+				fail(line_number, "glyph is not a printable ASCII character");
+			}
+			
+			glyph = (int)(code - GLYPH_FIRST);
+			row = 0;
+			continue;
+		}
+		
+		if (glyph < 0) {
+			if (line[0] != '\0') {
+				fail(line_number, "pixels outside of a glyph");
+			}
+			continue;
+		}
+		
+		if (strlen(line) != SOURCE_WIDTH) {
+			fail(line_number, "glyph rows must be 5 pixels wide");
+		}
+		for (i = 0; i < SOURCE_WIDTH; i++) {
+			if (line[i] == '#') {
+				atlas[glyph][GLYPH_TOP + row] |= 0x80 >> i;
+			} else if (line[i] != '.') {
+				fail(line_number, "pixels must be '#' or '.'");
+			}
+		}
+		
+		if (++row == SOURCE_HEIGHT) {
+			defined[glyph] = 1;
+			glyph = -1;
+		}
+	}
+	
+	if (glyph >= 0) {
+		fail(line_number, "last glyph is incomplete");
+	}
+	
+	printf("/* Generated by font/mkatlas from font/font.txt; do not edit. */\n\n");
+	printf("#pragma once\n#ifndef _glyphs_h\n#define _glyphs_h\n\n");
+	printf("#define GLYPH_WIDTH %d\n#define GLYPH_HEIGHT %d\n", GLYPH_WIDTH, GLYPH_HEIGHT);
+	printf("#define GLYPH_FIRST 0x%02x\n#define GLYPH_COUNT %d\n\n", GLYPH_FIRST, GLYPH_COUNT);
+	printf("static const UINT8 glyph_atlas[GLYPH_COUNT][GLYPH_HEIGHT] = {\n");
+	for (i = 0; i < GLYPH_COUNT; i++) {
+		if (!defined[i]) {
+			fprintf(stderr, "mkatlas: glyph 0x%02x is missing\n", i + GLYPH_FIRST);
+			return 1;
+		}
+		
+		printf("\t{");
+		for (j = 0; j < GLYPH_HEIGHT; j++) {
+			printf("0x%02x%s", atlas[i][j], j + 1 < GLYPH_HEIGHT ? ", " : "");
+		}
+		printf("}, // 0x%02x\n", i + GLYPH_FIRST);
+	}
+	printf("};\n\n#endif\n");
+	
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "graphics.h"
+#include "glyphs.h"
+
+/* The menus should get at least this many cells on the screen. */
+#define GRAPHICS_MIN_COLUMNS 100
+#define GRAPHICS_MIN_ROWS 30
+
+/*
+ * Glyphs are rendered into pixels the first time they are drawn with a given attribute
+ * and kept, so that drawing a cell is a plain copy. The menus only use a few attributes.
+ */
+#define GLYPH_CACHE_ATTRIBUTES 8
+
+static EFI_GRAPHICS_OUTPUT_PROTOCOL *gop = NULL;
+static UINT32 gop_mode;
+static UINTN width, height; // Of the screen, in pixels.
+static UINTN scale, cell_width, cell_height;
+static UINTN left, top; // Where the grid of cells starts, so that it is centred.
+static UINTN grid_columns;
+
+static EFI_GRAPHICS_OUTPUT_BLT_PIXEL *glyph_cache[GLYPH_CACHE_ATTRIBUTES][GLYPH_COUNT];
+static INTN cache_attributes[GLYPH_CACHE_ATTRIBUTES];
+static EFI_GRAPHICS_OUTPUT_BLT_PIXEL *span = NULL; // One row of cells being drawn.
+
+/* The colours of the sixteen text attribute colours. */
+static const EFI_GRAPHICS_OUTPUT_BLT_PIXEL palette[16] = {
+	{0x00, 0x00, 0x00, 0}, // Black
+	{0x98, 0x00, 0x00, 0}, // Blue
+	{0x00, 0x98, 0x00, 0}, // Green
+	{0x98, 0x98, 0x00, 0}, // Cyan
+	{0x00, 0x00, 0x98, 0}, // Red
+	{0x98, 0x00, 0x98, 0}, // Magenta
+	{0x00, 0x50, 0x98, 0}, // Brown
+	{0xb0, 0xb0, 0xb0, 0}, // Light gray
+	{0x50, 0x50, 0x50, 0}, // Dark gray
+	{0xff, 0x50, 0x50, 0}, // Light blue
+	{0x50, 0xff, 0x50, 0}, // Light green
+	{0xff, 0xff, 0x50, 0}, // Light cyan
+	{0x50, 0x50, 0xff, 0}, // Light red
+	{0xff, 0x50, 0xff, 0}, // Light magenta
+	{0x50, 0xff, 0xff, 0}, // Yellow
+	{0xff, 0xff, 0xff, 0}  // White
+};
+
+static VOID FreeGlyphCache(VOID) {
+	UINTN i, j;
+	
+	for (i = 0; i < GLYPH_CACHE_ATTRIBUTES; i++) {
+		for (j = 0; j < GLYPH_COUNT; j++) {
+			if (glyph_cache[i][j]) {
+				FreePool(glyph_cache[i][j]);
+				glyph_cache[i][j] = NULL;
+			}
+		}
+		cache_attributes[i] = -1;
+	}
+}
+
+VOID GraphicsShutdown(VOID) {
+	FreeGlyphCache();
+	if (span) {
+		FreePool(span);
+		span = NULL;
+	}
+	gop = NULL;
+}
+
+/*
+ * Sets up drawing on the graphics output device and returns the size of the grid of
+ * cells. Returns FALSE if there is no graphics output, in which case the text console
+ * has to be used.
+ */
+BOOLEAN GraphicsInitialize(OUT UINTN *columns, OUT UINTN *rows) {
+	EFI_GRAPHICS_OUTPUT_PROTOCOL *protocol;
+	UINTN horizontal, vertical;
+	
+	GraphicsShutdown();
+	if (EFI_ERROR(LibLocateProtocol(&GraphicsOutputProtocol, (VOID **)&protocol)) || !protocol->Mode ||
+		!protocol->Mode->Info) {
+		return FALSE;
+	}
+	
+	width = protocol->Mode->Info->HorizontalResolution;
+	height = protocol->Mode->Info->VerticalResolution;
+	if (width < GLYPH_WIDTH * 80 || height < GLYPH_HEIGHT * 25) {
+		return FALSE;
+	}
+	
+	horizontal = width / (GLYPH_WIDTH * GRAPHICS_MIN_COLUMNS);
+	vertical = height / (GLYPH_HEIGHT * GRAPHICS_MIN_ROWS);
+	scale = horizontal < vertical ? horizontal : vertical;
+	if (scale == 0) {
+		scale = 1;
+	}
+	
+	cell_width = GLYPH_WIDTH * scale;
+	cell_height = GLYPH_HEIGHT * scale;
+	grid_columns = width / cell_width;
+	*columns = grid_columns;
+	*rows = height / cell_height;
+	left = (width - *columns * cell_width) / 2;
+	top = (height - *rows * cell_height) / 2;
+	
+	span = AllocatePool(grid_columns * cell_width * cell_height * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+	if (!span) {
+		return FALSE;
+	}
+	
+	FreeGlyphCache();
+	gop = protocol;
+	gop_mode = protocol->Mode->Mode;
+	return TRUE;
+}
+
+/* Returns TRUE if the graphics mode was changed since GraphicsInitialize, e.g. by SetMode. */
+BOOLEAN GraphicsModeChanged(VOID) {
+	return !gop || gop->Mode->Mode != gop_mode ||
+		gop->Mode->Info->HorizontalResolution != width || gop->Mode->Info->VerticalResolution != height;
+}
+
+/* Fills the whole screen with the background colour. */
+VOID GraphicsClear(VOID) {
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL black = palette[0];
+	
+	if (gop) {
+		uefi_call_wrapper(gop->Blt, 10, gop, &black, EfiBltVideoFill, 0, 0, 0, 0, width, height, 0);
+	}
+}
+
+/* Scales a glyph of the atlas up into a block of pixels in the attribute's colours. */
+static VOID RenderGlyph(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *pixels, UINTN stride, UINTN glyph, UINT8 attribute) {
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL foreground = palette[attribute & 0x0f];
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL background = palette[(attribute >> 4) & 0x07];
+	UINTN x, y;
+	
+	for (y = 0; y < cell_height; y++) {
+		UINT8 bits = glyph_atlas[glyph][y / scale];
+		for (x = 0; x < cell_width; x++) {
+			pixels[y * stride + x] = (bits & (0x80 >> (x / scale))) ? foreground : background;
+		}
+	}
+}
+
+/* Returns the pixels of a glyph in an attribute, or NULL if they can't be cached. */
+static EFI_GRAPHICS_OUTPUT_BLT_PIXEL* CachedGlyph(UINTN glyph, UINT8 attribute) {
+	UINTN slot;
+	
+	for (slot = 0; slot < GLYPH_CACHE_ATTRIBUTES; slot++) {
+		if (cache_attributes[slot] == attribute) {
+			break;
+		}
+		if (cache_attributes[slot] == -1) {
+			cache_attributes[slot] = attribute;
+			break;
+		}
+	}
+	if (slot == GLYPH_CACHE_ATTRIBUTES) {
+		return NULL;
+	}
+	
+	if (!glyph_cache[slot][glyph]) {
+		glyph_cache[slot][glyph] = AllocatePool(cell_width * cell_height * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+		if (!glyph_cache[slot][glyph]) {
+			return NULL;
+		}
+		RenderGlyph(glyph_cache[slot][glyph], cell_width, glyph, attribute);
+	}
+	
+	return glyph_cache[slot][glyph];
+}
+
+/*
+ * Draws count cells of a row, starting at the given column, and copies just that
+ * rectangle to the screen.
+ */
+VOID GraphicsDrawCells(UINTN row, UINTN column, UINTN count, CHAR16 *chars, UINT8 *attributes) {
+	UINTN stride = count * cell_width, i, y;
+	
+	if (!gop || count == 0 || column + count > grid_columns) {
+		return;
+	}
+	
+	for (i = 0; i < count; i++) {
+		UINTN glyph = chars[i] >= GLYPH_FIRST && chars[i] < GLYPH_FIRST + GLYPH_COUNT ?
+			chars[i] - GLYPH_FIRST : '?' - GLYPH_FIRST;
+		EFI_GRAPHICS_OUTPUT_BLT_PIXEL *pixels = CachedGlyph(glyph, attributes[i]);
+		
+		if (pixels) {
+			for (y = 0; y < cell_height; y++) {
+				CopyMem(span + y * stride + i * cell_width, pixels + y * cell_width,
+					cell_width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+			}
+		} else {
+			RenderGlyph(span + i * cell_width, stride, glyph, attributes[i]);
+		}
+	}
+	
+	uefi_call_wrapper(gop->Blt, 10, gop, span, EfiBltBufferToVideo, 0, 0,
+		left + column * cell_width, top + row * cell_height, stride, cell_height,
+		stride * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+}
@@ -0,0 +1,36 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _graphics_h
+#define _graphics_h
+#include "main.h"
+
+/*
+ * Draws character cells straight onto the graphics output framebuffer, using the glyph
+ * atlas generated from font/font.txt at build time. The cells are scaled up so that the
+ * menus stay readable on large screens.
+ */
+BOOLEAN GraphicsInitialize(OUT UINTN *, OUT UINTN *);
+BOOLEAN GraphicsModeChanged(VOID);
+VOID GraphicsClear(VOID);
+VOID GraphicsDrawCells(UINTN, UINTN, UINTN, CHAR16 *, UINT8 *);
+VOID GraphicsShutdown(VOID);
+
+#endif
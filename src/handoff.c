@@ -0,0 +1,171 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "handoff.h"
+
+#define HANDOFF_HEADER_SIZE 16
+
+HandoffMode handoff_mode = HANDOFF_VARIABLES;
+
+/* Sets the handoff mode from the value of the handoff configuration key. */
+BOOLEAN SetHandoffMode(CHAR8 *value) {
+	if (strcmpa((CHAR8 *)"variables", value) == 0) {
+		handoff_mode = HANDOFF_VARIABLES;
+	} else if (strcmpa((CHAR8 *)"loadoptions", value) == 0) {
+		handoff_mode = HANDOFF_LOAD_OPTIONS;
+	} else if (strcmpa((CHAR8 *)"both", value) == 0) {
+		handoff_mode = HANDOFF_BOTH;
+	} else {
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+VOID HandoffInitialize(Handoff *handoff) {
+	handoff->capacity = 512;
+	handoff->size = HANDOFF_HEADER_SIZE;
+	handoff->failed = FALSE;
+	handoff->data = AllocateZeroPool(handoff->capacity);
+	if (!handoff->data) {
+		handoff->failed = TRUE;
+		return;
+	}
+	
+	CopyMem(handoff->data, HANDOFF_MAGIC, 8);
+}
+
+/* Stores every parameter of the blob in its variable. */
+static VOID SetHandoffVariables(Handoff *handoff) {
+	CHAR8 *p = handoff->data + HANDOFF_HEADER_SIZE;
+	CHAR16 name[64];
+	UINT16 name_length;
+	UINT32 value_length;
+	UINTN i;
+	
+	while (p < handoff->data + handoff->size) {
+		CopyMem(&name_length, p, sizeof(name_length));
+		p += sizeof(name_length);
+		for (i = 0; i < name_length && i < 63; i++) {
+			name[i] = p[i];
+		}
+		name[i] = L'\0';
+		p += name_length;
+		
+		CopyMem(&value_length, p, sizeof(value_length));
+		p += sizeof(value_length);
+		efi_set_variable(&grub_variable_guid, name, p, value_length, FALSE);
+		p += value_length;
+	}
+}
+
+/*
+ * Adds a parameter to the blob, under the name of the variable it would be stored in. If
+ * memory runs out, everything falls back to the variables.
+ */
+VOID HandoffAdd(Handoff *handoff, CHAR16 *name, CHAR8 *value) {
+	UINT16 name_length = (UINT16)StrLen(name);
+	UINT32 value_length = (UINT32)strlena(value) + 1;
+	UINTN needed = handoff->size + sizeof(name_length) + name_length + sizeof(value_length) + value_length;
+	UINT32 count;
+	UINTN i;
+	
+	if (handoff->failed) {
+		efi_set_variable(&grub_variable_guid, name, value, value_length, FALSE);
+		return;
+	}
+	
+	if (needed > handoff->capacity) {
+		UINTN capacity = handoff->capacity;
+		while (capacity < needed) {
+			capacity *= 2;
+		}
+		
+		CHAR8 *data = AllocatePool(capacity);
+		if (!data) {
+			SetHandoffVariables(handoff);
+			FreePool(handoff->data);
+			handoff->data = NULL;
+			handoff->failed = TRUE;
+			efi_set_variable(&grub_variable_guid, name, value, value_length, FALSE);
+			return;
+		}
+		
+		CopyMem(data, handoff->data, handoff->size);
+		FreePool(handoff->data);
+		handoff->data = data;
+		handoff->capacity = capacity;
+	}
+	
+	CHAR8 *p = handoff->data + handoff->size;
+	CopyMem(p, &name_length, sizeof(name_length));
+	p += sizeof(name_length);
+	for (i = 0; i < name_length; i++) {
+		*p++ = (CHAR8)name[i];
+	}
+	CopyMem(p, &value_length, sizeof(value_length));
+	p += sizeof(value_length);
+	CopyMem(p, value, value_length);
+	handoff->size = needed;
+	
+	CopyMem(&count, handoff->data + 12, sizeof(count));
+	count++;
+	CopyMem(handoff->data + 12, &count, sizeof(count));
+}
+
+/*
+ * Hands the parameters to the loaded but not yet started GRUB image, as the handoff mode
+ * asks. If the blob couldn't be built or attached, the variables are set instead. The
+ * blob belongs to the image afterwards and is not freed.
+ */
+EFI_STATUS HandoffFinish(Handoff *handoff, EFI_HANDLE image) {
+	EFI_LOADED_IMAGE *loaded_image;
+	EFI_STATUS err = EFI_SUCCESS;
+	UINT32 size = (UINT32)handoff->size;
+	
+	if (handoff->failed) {
+		// The variables have been set already.
+		return EFI_SUCCESS;
+	}
+	
+	CopyMem(handoff->data + 8, &size, sizeof(size));
+	
+	if (handoff_mode != HANDOFF_VARIABLES) {
+		err = uefi_call_wrapper(BS->HandleProtocol, 3, image, &LoadedImageProtocol, (VOID **)&loaded_image);
+		if (!EFI_ERROR(err)) {
+			loaded_image->LoadOptions = handoff->data;
+			loaded_image->LoadOptionsSize = size;
+		}
+	}
+	
+	if (handoff_mode != HANDOFF_LOAD_OPTIONS || EFI_ERROR(err)) {
+		SetHandoffVariables(handoff);
+	}
+	
+	if (handoff_mode == HANDOFF_VARIABLES || EFI_ERROR(err)) {
+		FreePool(handoff->data);
+		handoff->data = NULL;
+	}
+	
+	return EFI_SUCCESS;
+}
@@ -0,0 +1,63 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _handoff_h
+#define _handoff_h
+#include "main.h"
+
+/*
+ * The boot parameters are handed to GRUB either as EFI variables, or packed into a
+ * single blob that is passed as GRUB's load options. The blob looks like this, with all
+ * numbers in the machine's byte order:
+ *
+ *     8 bytes    HANDOFF_MAGIC
+ *     UINT32     size of the whole blob in bytes
+ *     UINT32     number of parameters
+ *
+ * followed by each parameter:
+ *
+ *     UINT16     length of the name
+ *     name       the name of the matching variable, e.g. Enterprise_ISOPath, in ASCII
+ *     UINT32     length of the value, including its terminating null character
+ *     value      the value, exactly as it would have been stored in the variable
+ */
+#define HANDOFF_MAGIC "ENTHOFF1"
+
+typedef enum {
+	HANDOFF_VARIABLES = 0, // Only set the variables; works with every GRUB.
+	HANDOFF_LOAD_OPTIONS,  // Only pass the blob, for a GRUB that knows how to read it.
+	HANDOFF_BOTH
+} HandoffMode;
+
+typedef struct Handoff {
+	CHAR8 *data;
+	UINTN size;
+	UINTN capacity;
+	BOOLEAN failed;
+} Handoff;
+
+extern HandoffMode handoff_mode;
+
+BOOLEAN SetHandoffMode(CHAR8 *);
+VOID HandoffInitialize(Handoff *);
+VOID HandoffAdd(Handoff *, CHAR16 *, CHAR8 *);
+EFI_STATUS HandoffFinish(Handoff *, EFI_HANDLE);
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "menu.h"
+#include "utils.h"
+#include "hardware.h"
+
+#define HARDWARE_VENDOR 0
+#define HARDWARE_PRODUCT 1
+#define HARDWARE_BOARD 2
+#define HARDWARE_FIELDS 3
+
+/* Newer firmware may only publish the 64-bit SMBIOS 3 entry point. */
+static EFI_GUID smbios3_table_guid = {0xf2fd1544, 0x9794, 0x4a2c, {0x99, 0x2e, 0xe5, 0xbb, 0xcf, 0x20, 0xe3, 0x94}};
+
+typedef struct HardwareRule {
+	LinuxBootOption *option;
+	CHAR8 *fields[HARDWARE_FIELDS]; // NULL for a field that can be anything.
+	CHAR8 *kernel_options;
+	UINT64 key;
+	struct HardwareRule *next;
+} HardwareRule;
+
+static HardwareRule *rules = NULL, *rules_tail = NULL;
+static UINTN rule_count = 0;
+
+static CHAR8 *machine[HARDWARE_FIELDS];
+static HardwareRule *matched_rule = NULL;
+
+/* Returns the given string of an SMBIOS structure, counting from one, or NULL. */
+static CHAR8* SMBIOSString(UINT8 *structure, UINT8 *end, UINT8 number) {
+	CHAR8 *string = (CHAR8 *)structure + structure[1];
+	
+	if (number == 0) {
+		return NULL;
+	}
+	
+	while (--number > 0 && (UINT8 *)string < end && *string) {
+		while ((UINT8 *)string < end && *string) {
+			string++;
+		}
+		string++;
+	}
+	
+	return (UINT8 *)string < end && *string ? string : NULL;
+}
+
+/* Finds the vendor, product and board names of this machine in the SMBIOS tables. */
+static VOID ReadMachineIdentity(VOID) {
+	UINT8 *entry_point = NULL, *structure, *end;
+	
+	if (!EFI_ERROR(LibGetSystemConfigurationTable(&smbios3_table_guid, (VOID **)&entry_point)) &&
+		CompareMem(entry_point, "_SM3_", 5) == 0) {
+		structure = (UINT8 *)(UINTN)*(UINT64 *)(entry_point + 0x10);
+		end = structure + *(UINT32 *)(entry_point + 0x0c);
+	} else if (!EFI_ERROR(LibGetSystemConfigurationTable(&SMBIOSTableGuid, (VOID **)&entry_point)) &&
+		CompareMem(entry_point, "_SM_", 4) == 0) {
+		structure = (UINT8 *)(UINTN)*(UINT32 *)(entry_point + 0x18);
+		end = structure + *(UINT16 *)(entry_point + 0x16);
+	} else {
+		return;
+	}
+	
+	// Each structure is a header with its type and length, more fields, and then its
+	// strings, which end with an empty one.
+	while (structure + 4 <= end && structure[1] >= 4 && structure[0] != 127) {
+		UINT8 *next = structure + structure[1];
+		
+		if (structure[0] == 1 && structure[1] > 5) {
+			machine[HARDWARE_VENDOR] = SMBIOSString(structure, end, structure[4]);
+			machine[HARDWARE_PRODUCT] = SMBIOSString(structure, end, structure[5]);
+		} else if (structure[0] == 2 && structure[1] > 5) {
+			machine[HARDWARE_BOARD] = SMBIOSString(structure, end, structure[5]);
+		}
+		
+		while (next + 1 < end && (next[0] || next[1])) {
+			next++;
+		}
+		structure = next + 2;
+	}
+}
+
+/* Hashes the fields that are in the mask, so that rules and the machine can be compared. */
+static UINT64 HardwareKey(CHAR8 **fields, UINTN mask) {
+	UINT8 byte = mask;
+	UINT64 hash = HashBytes(&byte, 1, HASH_INITIAL_VALUE);
+	UINTN i;
+	
+	for (i = 0; i < HARDWARE_FIELDS; i++) {
+		if (mask & (1 << i)) {
+			hash = HashBytes(fields[i], strlena(fields[i]) + 1, hash);
+		}
+	}
+	
+	return hash;
+}
+
+/* Returns the mask of the fields the rule cares about. */
+static UINTN RuleMask(HardwareRule *rule) {
+	UINTN i, mask = 0;
+	
+	for (i = 0; i < HARDWARE_FIELDS; i++) {
+		if (rule->fields[i]) {
+			mask |= 1 << i;
+		}
+	}
+	
+	return mask;
+}
+
+/* Checks the fields in the mask one by one, in case two keys happen to be the same. */
+static BOOLEAN RuleMatchesMachine(HardwareRule *rule, UINTN mask) {
+	UINTN i;
+	
+	for (i = 0; i < HARDWARE_FIELDS; i++) {
+		if (mask & (1 << i) && strcmpa(rule->fields[i], machine[i]) != 0) {
+			return FALSE;
+		}
+	}
+	
+	return TRUE;
+}
+
+/*
+ * Adds a setting from the configuration file to the rule of the given entry. The setting
+ * is one of match_vendor, match_product, match_board or match_options. Returns FALSE if
+ * it isn't one of those.
+ */
+BOOLEAN AddHardwareRule(LinuxBootOption *option, CHAR8 *key, CHAR8 *value) {
+	CHAR8 **target;
+	
+	if (!rules_tail || rules_tail->option != option) {
+		HardwareRule *rule = AllocateZeroPool(sizeof(HardwareRule));
+		if (!rule) {
+			return TRUE;
+		}
+		
+		rule->option = option;
+		if (rules_tail) {
+			rules_tail->next = rule;
+		} else {
+			rules = rule;
+		}
+		rules_tail = rule;
+		rule_count++;
+	}
+	
+	if (strcmpa((CHAR8 *)"match_vendor", key) == 0) {
+		target = &rules_tail->fields[HARDWARE_VENDOR];
+	} else if (strcmpa((CHAR8 *)"match_product", key) == 0) {
+		target = &rules_tail->fields[HARDWARE_PRODUCT];
+	} else if (strcmpa((CHAR8 *)"match_board", key) == 0) {
+		target = &rules_tail->fields[HARDWARE_BOARD];
+	} else if (strcmpa((CHAR8 *)"match_options", key) == 0) {
+		target = &rules_tail->kernel_options;
+	} else {
+		return FALSE;
+	}
+	
+	if (*target) {
+		FreePool(*target);
+	}
+	*target = AllocatePool(strlena(value) + 1);
+	if (*target) {
+		strcpya(*target, value);
+	}
+	
+	return TRUE;
+}
+
+/*
+ * Looks this machine up among the rules, once, and presets the kernel options of the
+ * rule that matches. Rules are put in a table by the fields they name, so that only the
+ * seven combinations of this machine's fields need to be looked up; rules that name more
+ * fields win. Returns the position of the matching entry, counting from zero, or -1.
+ */
+INTN MatchHardwareProfile(VOID) {
+	static const UINTN masks[] = { 7, 3, 5, 6, 1, 2, 4 }; // Most specific first.
+	HardwareRule *rule, **table;
+	BootableLinuxDistro *conductor;
+	UINTN table_size, slot, i;
+	INTN position;
+	
+	if (!rules || !distributionListRoot) {
+		return -1;
+	}
+	
+	for (table_size = 8; table_size < rule_count * 2; table_size *= 2);
+	table = AllocateZeroPool(table_size * sizeof(HardwareRule *));
+	if (!table) {
+		return -1;
+	}
+	
+	// Keep the first of several rules for the same machines.
+	for (rule = rules; rule; rule = rule->next) {
+		UINTN mask = RuleMask(rule);
+		if (mask == 0) {
+			continue;
+		}
+		
+		rule->key = HardwareKey(rule->fields, mask);
+		for (slot = rule->key & (table_size - 1); table[slot] && table[slot]->key != rule->key;
+			slot = (slot + 1) & (table_size - 1));
+		if (!table[slot]) {
+			table[slot] = rule;
+		}
+	}
+	
+	ReadMachineIdentity();
+	for (i = 0; i < sizeof(masks) / sizeof(masks[0]) && !matched_rule; i++) {
+		UINTN mask = masks[i];
+		UINT64 key;
+		
+		if ((mask & 1 && !machine[HARDWARE_VENDOR]) || (mask & 2 && !machine[HARDWARE_PRODUCT]) ||
+			(mask & 4 && !machine[HARDWARE_BOARD])) {
+			continue;
+		}
+		
+		key = HardwareKey(machine, mask);
+		for (slot = key & (table_size - 1); table[slot]; slot = (slot + 1) & (table_size - 1)) {
+			if (table[slot]->key == key && RuleMatchesMachine(table[slot], mask)) {
+				matched_rule = table[slot];
+				break;
+			}
+		}
+	}
+	FreePool(table);
+	
+	if (!matched_rule) {
+		return -1;
+	}
+	
+	if (matched_rule->kernel_options) {
+		PresetKernelOptions(matched_rule->kernel_options);
+	}
+	
+	// The entry may have been left out since, if its configuration file had a mistake.
+	for (position = 0, conductor = distributionListRoot->next; conductor; conductor = conductor->next, position++) {
+		if (conductor->bootOption == matched_rule->option) {
+			return position;
+		}
+	}
+	
+	return -1;
+}
+
+/* Returns the kernel options of the rule that matched this machine, for booting without the menu. */
+CHAR16* HardwareKernelOptions(VOID) {
+	CHAR16 *options;
+	
+	if (!matched_rule || !matched_rule->kernel_options) {
+		return L"";
+	}
+	
+	options = ASCIItoUTF16(matched_rule->kernel_options, strlena(matched_rule->kernel_options));
+	return options ? options : L"";
+}
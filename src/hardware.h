@@ -0,0 +1,34 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _hardware_h
+#define _hardware_h
+#include "main.h"
+
+/*
+ * Entries can name the machines they are meant for, by the system vendor, the product
+ * name and the board name found in the SMBIOS tables. On a machine that matches, the
+ * entry becomes the default and its kernel options are preset.
+ */
+BOOLEAN AddHardwareRule(LinuxBootOption *, CHAR8 *, CHAR8 *);
+INTN MatchHardwareProfile(VOID);
+CHAR16* HardwareKernelOptions(VOID);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "utils.h"
+
+/*
+ * Microbenchmarks of reading and parsing configuration files, run on the host by "make
+ * bench". Configurations of 10 to 10,000 entries are generated, and each operation is
+ * repeated until it has run for BENCHMARK_SECONDS. Sizes given on the command line
+ * replace the default ones.
+ */
+#define BENCHMARK_SECONDS 0.25
+
+static const UINTN default_sizes[] = { 10, 100, 1000, 10000 };
+
+static char directory[] = "/tmp/enterprise-bench-XXXXXX";
+static EFI_FILE_HANDLE root;
+
+static double Now(VOID) {
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Writes a configuration like the ones users write, with some comments and CRLF lines. */
+static UINTN GenerateConfiguration(const char *name, UINTN entries, UINTN *lines) {
+	char path[256];
+	UINTN i, bytes = 0;
+	FILE *file;
+	
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	file = fopen(path, "wb");
+	if (!file) {
+		perror(path);
+		exit(1);
+	}
+	
+	*lines = 0;
+	for (i = 0; i < entries; i++) {
+		const char *newline = i % 2 ? "\r\n" : "\n";
+		
+		if (i % 10 == 0) {
+			bytes += fprintf(file, "# Entries %lu and up%s%s", (unsigned long)i, newline, newline);
+		}
+		bytes += fprintf(file, "entry Distribution %lu%s", (unsigned long)i, newline);
+		bytes += fprintf(file, "\tfamily Ubuntu%s", newline);
+		bytes += fprintf(file, "\tiso /isos/distribution-%lu.iso%s", (unsigned long)i, newline);
+		bytes += fprintf(file, "\tkernel /casper/vmlinuz.efi%s", newline);
+		bytes += fprintf(file, "\troot live:CDLABEL=Distribution%lu boot=casper quiet splash  %s", (unsigned long)i, newline);
+		*lines += 5;
+	}
+	
+	fclose(file);
+	return bytes;
+}
+
+static VOID Benchmark(UINTN entries) {
+	CHAR8 *contents = NULL, *copy, *key, *value;
+	CHAR8 **values;
+	UINTN bytes, lines, length, runs, pos, count, i, allocations;
+	double start, elapsed, read_time, parse_time, widen_time, narrow_time, scan_time;
+	CHAR16 name[64];
+	char file_name[64];
+	
+	snprintf(file_name, sizeof(file_name), "bench-%lu.cfg", (unsigned long)entries);
+	for (i = 0; file_name[i]; i++) {
+		name[i + 1] = file_name[i];
+	}
+	name[0] = '\\';
+	name[i + 1] = '\0';
+	bytes = GenerateConfiguration(file_name, entries, &lines);
+	
+	// FileRead, from opening the file to the buffer, with nothing cached.
+	elapsed = 0;
+	for (runs = 0; elapsed < BENCHMARK_SECONDS; runs++) {
+		FileCacheFlush();
+		start = Now();
+		length = FileRead(root, name, &contents);
+		elapsed += Now() - start;
+		if (length != bytes) {
+			fprintf(stderr, "FileRead returned %lu of %lu bytes\n", (unsigned long)length, (unsigned long)bytes);
+			exit(1);
+		}
+		FreePool(contents);
+	}
+	read_time = elapsed / runs;
+	length = FileRead(root, name, &contents);
+	
+	// Splitting every line into its key and value. The parser writes into the buffer,
+	// so it works on a fresh copy each time, which isn't timed.
+	copy = malloc(length + 1);
+	elapsed = 0;
+	for (runs = 0; elapsed < BENCHMARK_SECONDS; runs++) {
+		memcpy(copy, contents, length + 1);
+		pos = count = 0;
+		start = Now();
+		while (GetConfigurationKeyAndValue(copy, &pos, &key, &value)) {
+			count++;
+		}
+		elapsed += Now() - start;
+		if (count != lines) {
+			fprintf(stderr, "parsed %lu of %lu lines\n", (unsigned long)count, (unsigned long)lines);
+			exit(1);
+		}
+	}
+	parse_time = elapsed / runs;
+	
+	// Converting every value to UTF-16 and back, as the menus do for their labels.
+	values = malloc(lines * sizeof(CHAR8 *));
+	memcpy(copy, contents, length + 1);
+	for (pos = count = 0; GetConfigurationKeyAndValue(copy, &pos, &key, &value); count++) {
+		values[count] = value;
+	}
+	
+	CHAR16 **wide = malloc(lines * sizeof(CHAR16 *));
+	allocations = host_counters.total_allocations;
+	widen_time = narrow_time = 0;
+	for (runs = 0; widen_time + narrow_time < BENCHMARK_SECONDS; runs++) {
+		start = Now();
+		for (i = 0; i < lines; i++) {
+			wide[i] = ASCIItoUTF16(values[i], strlena(values[i]));
+		}
+		widen_time += Now() - start;
+		
+		start = Now();
+		for (i = 0; i < lines; i++) {
+			CHAR8 *narrow = UTF16toASCII(wide[i], StrLen(wide[i]) + 1);
+			FreePool(narrow);
+		}
+		narrow_time += Now() - start;
+		
+		for (i = 0; i < lines; i++) {
+			FreePool(wide[i]);
+		}
+	}
+	allocations = (host_counters.total_allocations - allocations) / runs;
+	widen_time /= runs;
+	narrow_time /= runs;
+	
+	// Looking for a character that isn't there, over the whole file.
+	elapsed = 0;
+	for (runs = 0; elapsed < BENCHMARK_SECONDS; runs++) {
+		start = Now();
+		if (strchra(contents, '@')) {
+			exit(1);
+		}
+		elapsed += Now() - start;
+	}
+	scan_time = elapsed / runs;
+	
+	printf("%8lu %10lu %12.1f %9.1f %10.1f %10.1f %10.1f %9.1f %8.1f\n",
+		(unsigned long)entries, (unsigned long)bytes,
+		read_time * 1e6, bytes / read_time / 1e6,
+		parse_time * 1e9 / lines,
+		widen_time * 1e9 / lines, narrow_time * 1e9 / lines,
+		bytes / scan_time / 1e6,
+		(double)allocations / lines);
+	
+	FreePool(contents);
+	free(copy);
+	free(values);
+	free(wide);
+	FileCacheFlush();
+	snprintf(file_name, sizeof(file_name), "%s/bench-%lu.cfg", directory, (unsigned long)entries);
+	unlink(file_name);
+}
+
+int main(int argc, char **argv) {
+	int i;
+	
+	if (!mkdtemp(directory) || !(root = HostOpenRoot(directory))) {
+		perror(directory);
+		return 1;
+	}
+	
+	printf("%8s %10s %12s %9s %10s %10s %10s %9s %8s\n", "entries", "bytes", "FileRead us",
+		"MB/s", "parse ns", "widen ns", "narrow ns", "scan MB/s", "allocs");
+	printf("%8s %10s %12s %9s %10s %10s %10s %9s %8s\n", "", "", "", "", "per line",
+		"per value", "per value", "", "per value");
+	
+	if (argc > 1) {
+		for (i = 1; i < argc; i++) {
+			Benchmark(strtoul(argv[i], NULL, 10));
+		}
+	} else {
+		for (i = 0; i < (int)(sizeof(default_sizes) / sizeof(default_sizes[0])); i++) {
+			Benchmark(default_sizes[i]);
+		}
+	}
+	
+	root->Close(root);
+	rmdir(directory);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+/*
+ * The parts of the gnu-efi headers that the code built by the host Makefile needs, so
+ * that it can be compiled and run as an ordinary program. efistub.c implements the
+ * boot and runtime services on top of the C library.
+ */
+#pragma once
+#ifndef _host_efi_h
+#define _host_efi_h
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int8_t INT8;
+typedef int16_t INT16;
+typedef int32_t INT32;
+typedef int64_t INT64;
+typedef uintptr_t UINTN;
+typedef intptr_t INTN;
+typedef unsigned char CHAR8;
+typedef unsigned short CHAR16; // Needs -fshort-wchar, so that L"" strings match.
+typedef unsigned char BOOLEAN;
+#define VOID void
+
+typedef UINTN EFI_STATUS;
+typedef VOID *EFI_HANDLE;
+typedef VOID *EFI_EVENT;
+typedef UINT64 EFI_LBA;
+typedef UINTN EFI_TPL;
+typedef UINT64 EFI_PHYSICAL_ADDRESS;
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+#define CONST const
+#define TRUE ((BOOLEAN)1)
+#define FALSE ((BOOLEAN)0)
+
+#define uefi_call_wrapper(func, va_num, ...) (func)(__VA_ARGS__)
+
+typedef struct {
+	UINT32 Data1;
+	UINT16 Data2;
+	UINT16 Data3;
+	UINT8 Data4[8];
+} EFI_GUID;
+
+typedef struct {
+	UINT16 Year;
+	UINT8 Month, Day, Hour, Minute, Second, Pad1;
+	UINT32 Nanosecond;
+	INT16 TimeZone;
+	UINT8 Daylight, Pad2;
+} EFI_TIME;
+
+#define EFI_MAX_BIT ((UINTN)1 << (sizeof(UINTN) * 8 - 1))
+#define EFIERR(a) (EFI_MAX_BIT | (a))
+#define EFI_ERROR(a) (((INTN)(a)) < 0)
+
+#define EFI_SUCCESS 0
+#define EFI_LOAD_ERROR EFIERR(1)
+#define EFI_INVALID_PARAMETER EFIERR(2)
+#define EFI_UNSUPPORTED EFIERR(3)
+#define EFI_BAD_BUFFER_SIZE EFIERR(4)
+#define EFI_BUFFER_TOO_SMALL EFIERR(5)
+#define EFI_NOT_READY EFIERR(6)
+#define EFI_DEVICE_ERROR EFIERR(7)
+#define EFI_WRITE_PROTECTED EFIERR(8)
+#define EFI_OUT_OF_RESOURCES EFIERR(9)
+#define EFI_VOLUME_CORRUPTED EFIERR(10)
+#define EFI_NOT_FOUND EFIERR(14)
+#define EFI_ACCESS_DENIED EFIERR(15)
+#define EFI_ABORTED EFIERR(21)
+#define EFI_INCOMPATIBLE_VERSION EFIERR(25)
+#define EFI_END_OF_FILE EFIERR(31)
+
+#define EFI_VARIABLE_NON_VOLATILE 0x1
+#define EFI_VARIABLE_BOOTSERVICE_ACCESS 0x2
+#define EFI_VARIABLE_RUNTIME_ACCESS 0x4
+
+#define EFI_PAGE_SIZE 4096
+#define EFI_PAGE_SHIFT 12
+#define EFI_SIZE_TO_PAGES(a) (((a) >> EFI_PAGE_SHIFT) + (((a) & 0xfff) ? 1 : 0))
+
+typedef enum { AllocateAnyPages, AllocateMaxAddress, AllocateAddress, MaxAllocateType } EFI_ALLOCATE_TYPE;
+typedef enum {
+	EfiReservedMemoryType, EfiLoaderCode, EfiLoaderData, EfiBootServicesCode, EfiBootServicesData,
+	EfiRuntimeServicesCode, EfiRuntimeServicesData, EfiConventionalMemory, EfiMaxMemoryType = 15
+} EFI_MEMORY_TYPE;
+
+#define TPL_APPLICATION 4
+#define TPL_CALLBACK 8
+#define TPL_NOTIFY 16
+#define TPL_HIGH_LEVEL 31
+
+#define EVT_TIMER 0x80000000
+#define EVT_NOTIFY_SIGNAL 0x00000200
+typedef enum { TimerCancel, TimerPeriodic, TimerRelative } EFI_TIMER_DELAY;
+typedef VOID (EFIAPI *EFI_EVENT_NOTIFY)(EFI_EVENT, VOID *);
+
+typedef struct {
+	UINT64 Signature;
+	UINT32 Revision;
+	UINT32 HeaderSize;
+	UINT32 CRC32;
+	UINT32 Reserved;
+} EFI_TABLE_HEADER;
+
+typedef struct _EFI_DEVICE_PATH {
+	UINT8 Type;
+	UINT8 SubType;
+	UINT8 Length[2];
+} EFI_DEVICE_PATH;
+
+typedef struct {
+	UINT16 ScanCode;
+	CHAR16 UnicodeChar;
+} EFI_INPUT_KEY;
+
+typedef struct _SIMPLE_TEXT_OUTPUT_INTERFACE {
+	EFI_STATUS (EFIAPI *OutputString)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, CHAR16 *);
+	EFI_STATUS (EFIAPI *SetAttribute)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, UINTN);
+} SIMPLE_TEXT_OUTPUT_INTERFACE;
+
+#define EFI_BLACK 0x00
+#define EFI_RED 0x04
+#define EFI_LIGHTGRAY 0x07
+#define EFI_LIGHTRED 0x0C
+#define EFI_YELLOW 0x0E
+#define EFI_WHITE 0x0F
+#define EFI_BACKGROUND_BLACK 0x00
+
+typedef struct {
+	UINT64 Size;
+	UINT64 FileSize;
+	UINT64 PhysicalSize;
+	EFI_TIME CreateTime;
+	EFI_TIME LastAccessTime;
+	EFI_TIME ModificationTime;
+	UINT64 Attribute;
+	CHAR16 FileName[1];
+} EFI_FILE_INFO;
+
+#define SIZE_OF_EFI_FILE_INFO offsetof(EFI_FILE_INFO, FileName)
+#define EFI_FILE_MODE_READ 0x0000000000000001ULL
+#define EFI_FILE_DIRECTORY 0x10
+#define EFI_FILE_HANDLE_REVISION 0x00010000
+
+typedef struct _EFI_FILE_HANDLE {
+	UINT64 Revision;
+	EFI_STATUS (EFIAPI *Open)(struct _EFI_FILE_HANDLE *, struct _EFI_FILE_HANDLE **, CHAR16 *, UINT64, UINT64);
+	EFI_STATUS (EFIAPI *Close)(struct _EFI_FILE_HANDLE *);
+	EFI_STATUS (EFIAPI *Delete)(struct _EFI_FILE_HANDLE *);
+	EFI_STATUS (EFIAPI *Read)(struct _EFI_FILE_HANDLE *, UINTN *, VOID *);
+	EFI_STATUS (EFIAPI *Write)(struct _EFI_FILE_HANDLE *, UINTN *, VOID *);
+	EFI_STATUS (EFIAPI *GetPosition)(struct _EFI_FILE_HANDLE *, UINT64 *);
+	EFI_STATUS (EFIAPI *SetPosition)(struct _EFI_FILE_HANDLE *, UINT64);
+	EFI_STATUS (EFIAPI *GetInfo)(struct _EFI_FILE_HANDLE *, EFI_GUID *, UINTN *, VOID *);
+	EFI_STATUS (EFIAPI *SetInfo)(struct _EFI_FILE_HANDLE *, EFI_GUID *, UINTN, VOID *);
+	EFI_STATUS (EFIAPI *Flush)(struct _EFI_FILE_HANDLE *);
+} EFI_FILE, *EFI_FILE_HANDLE;
+
+typedef struct {
+	UINT32 MediaId;
+	BOOLEAN RemovableMedia;
+	BOOLEAN MediaPresent;
+	BOOLEAN LogicalPartition;
+	BOOLEAN ReadOnly;
+	BOOLEAN WriteCaching;
+	UINT32 BlockSize;
+	UINT32 IoAlign;
+	EFI_LBA LastBlock;
+} EFI_BLOCK_IO_MEDIA;
+
+typedef struct _EFI_BLOCK_IO {
+	UINT64 Revision;
+	EFI_BLOCK_IO_MEDIA *Media;
+} EFI_BLOCK_IO;
+
+typedef struct {
+	UINT32 Revision;
+	EFI_HANDLE ParentHandle;
+	VOID *SystemTable;
+	EFI_HANDLE DeviceHandle;
+	EFI_DEVICE_PATH *FilePath;
+	VOID *Reserved;
+	UINT32 LoadOptionsSize;
+	VOID *LoadOptions;
+	VOID *ImageBase;
+	UINT64 ImageSize;
+} EFI_LOADED_IMAGE;
+
+/* Only the services used by the host build; the order doesn't match the firmware's. */
+typedef struct {
+	EFI_TABLE_HEADER Hdr;
+	EFI_TPL (EFIAPI *RaiseTPL)(EFI_TPL);
+	VOID (EFIAPI *RestoreTPL)(EFI_TPL);
+	EFI_STATUS (EFIAPI *AllocatePages)(EFI_ALLOCATE_TYPE, EFI_MEMORY_TYPE, UINTN, EFI_PHYSICAL_ADDRESS *);
+	EFI_STATUS (EFIAPI *FreePages)(EFI_PHYSICAL_ADDRESS, UINTN);
+	EFI_STATUS (EFIAPI *CreateEvent)(UINT32, EFI_TPL, EFI_EVENT_NOTIFY, VOID *, EFI_EVENT *);
+	EFI_STATUS (EFIAPI *WaitForEvent)(UINTN, EFI_EVENT *, UINTN *);
+	EFI_STATUS (EFIAPI *CloseEvent)(EFI_EVENT);
+	EFI_STATUS (EFIAPI *HandleProtocol)(EFI_HANDLE, EFI_GUID *, VOID **);
+	EFI_STATUS (EFIAPI *Stall)(UINTN);
+} EFI_BOOT_SERVICES;
+
+typedef struct {
+	EFI_TABLE_HEADER Hdr;
+	EFI_STATUS (EFIAPI *GetVariable)(CHAR16 *, EFI_GUID *, UINT32 *, UINTN *, VOID *);
+	EFI_STATUS (EFIAPI *SetVariable)(CHAR16 *, EFI_GUID *, UINT32, UINTN, VOID *);
+} EFI_RUNTIME_SERVICES;
+
+typedef struct _EFI_SYSTEM_TABLE {
+	EFI_TABLE_HEADER Hdr;
+	CHAR16 *FirmwareVendor;
+	UINT32 FirmwareRevision;
+	SIMPLE_TEXT_OUTPUT_INTERFACE *ConOut;
+	EFI_RUNTIME_SERVICES *RuntimeServices;
+	EFI_BOOT_SERVICES *BootServices;
+} EFI_SYSTEM_TABLE;
+
+#endif
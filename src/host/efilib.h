@@ -0,0 +1,65 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+/* The library functions of gnu-efi used by the host build, and the host's own helpers. */
+#pragma once
+#ifndef _host_efilib_h
+#define _host_efilib_h
+#include "efi.h"
+
+extern EFI_SYSTEM_TABLE *ST;
+extern EFI_BOOT_SERVICES *BS;
+extern EFI_RUNTIME_SERVICES *RT;
+extern EFI_GUID BlockIoProtocol, GenericFileInfo;
+
+UINTN Print(CHAR16 *, ...);
+VOID *AllocatePool(UINTN);
+VOID *AllocateZeroPool(UINTN);
+VOID FreePool(VOID *);
+VOID ZeroMem(VOID *, UINTN);
+VOID SetMem(VOID *, UINTN, UINT8);
+VOID CopyMem(VOID *, VOID *, UINTN);
+INTN CompareMem(VOID *, VOID *, UINTN);
+INTN StrCmp(CHAR16 *, CHAR16 *);
+INTN StriCmp(CHAR16 *, CHAR16 *);
+UINTN StrLen(CHAR16 *);
+CHAR16 *StrDuplicate(CHAR16 *);
+UINTN strlena(CHAR8 *);
+INTN strcmpa(CHAR8 *, CHAR8 *);
+INTN strncmpa(CHAR8 *, CHAR8 *, UINTN);
+EFI_FILE_INFO *LibFileInfo(EFI_FILE_HANDLE);
+
+/*
+ * Host only. Opens a directory of the host's file system as the root of a volume, and
+ * counts what the code under test asks of the firmware.
+ */
+EFI_FILE_HANDLE HostOpenRoot(const char *);
+
+typedef struct {
+	UINTN allocations; // Pool allocations not freed yet.
+	UINTN total_allocations;
+	UINTN file_opens;
+	UINTN file_reads;
+	UINTN variable_writes;
+	EFI_TPL tpl;
+} HostCounters;
+
+extern HostCounters host_counters;
+
+#endif
@@ -0,0 +1,607 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+/*
+ * Boot and runtime services for running the loader's parsing code as a host program.
+ * Pool memory comes from malloc, files from the host's file system, and variables are
+ * kept in a list in memory. Everything the code asks for is counted in host_counters.
+ */
+HostCounters host_counters = { .tpl = TPL_APPLICATION };
+
+EFI_GUID BlockIoProtocol = { 0x964e5b21, 0x6459, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID GenericFileInfo = { 0x09576e92, 0x6d3f, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+
+#ifdef __APPLE__
+	#pragma mark - Memory and strings
+#endif
+VOID *AllocatePool(UINTN size) {
+	VOID *p = malloc(size ? size : 1);
+	
+	if (p) {
+		host_counters.allocations++;
+		host_counters.total_allocations++;
+	}
+	return p;
+}
+
+VOID *AllocateZeroPool(UINTN size) {
+	VOID *p = AllocatePool(size);
+	
+	if (p) {
+		memset(p, 0, size);
+	}
+	return p;
+}
+
+VOID FreePool(VOID *p) {
+	if (p) {
+		host_counters.allocations--;
+	}
+	free(p);
+}
+
+VOID ZeroMem(VOID *buffer, UINTN size) {
+	memset(buffer, 0, size);
+}
+
+VOID SetMem(VOID *buffer, UINTN size, UINT8 value) {
+	memset(buffer, value, size);
+}
+
+VOID CopyMem(VOID *dest, VOID *src, UINTN size) {
+	memmove(dest, src, size);
+}
+
+INTN CompareMem(VOID *a, VOID *b, UINTN size) {
+	return memcmp(a, b, size);
+}
+
+UINTN StrLen(CHAR16 *s) {
+	UINTN len = 0;
+	
+	while (s[len]) {
+		len++;
+	}
+	return len;
+}
+
+INTN StrCmp(CHAR16 *a, CHAR16 *b) {
+	for (; *a && *a == *b; a++, b++);
+	return *a - *b;
+}
+
+static CHAR16 ToUpper(CHAR16 c) {
+	return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+INTN StriCmp(CHAR16 *a, CHAR16 *b) {
+	for (; *a && ToUpper(*a) == ToUpper(*b); a++, b++);
+	return ToUpper(*a) - ToUpper(*b);
+}
+
+CHAR16 *StrDuplicate(CHAR16 *s) {
+	UINTN size = (StrLen(s) + 1) * sizeof(CHAR16);
+	CHAR16 *copy = AllocatePool(size);
+	
+	if (copy) {
+		memcpy(copy, s, size);
+	}
+	return copy;
+}
+
+UINTN strlena(CHAR8 *s) {
+	return strlen((char *)s);
+}
+
+INTN strcmpa(CHAR8 *a, CHAR8 *b) {
+	return strcmp((char *)a, (char *)b);
+}
+
+INTN strncmpa(CHAR8 *a, CHAR8 *b, UINTN n) {
+	return strncmp((char *)a, (char *)b, n);
+}
+
+/* Understands the formats the loader actually uses: %s, %a, %c, %d, %u, %x and %r. */
+UINTN Print(CHAR16 *format, ...) {
+	va_list args;
+	UINTN count = 0;
+	
+	va_start(args, format);
+	for (; *format; format++) {
+		if (*format != '%') {
+			putchar(*format < 0x80 ? *format : '?');
+			count++;
+			continue;
+		}
+		
+		format++;
+		while (*format == 'l' || (*format >= '0' && *format <= '9')) {
+			format++;
+		}
+		
+		switch (*format) {
+			case 's': {
+				CHAR16 *s = va_arg(args, CHAR16 *);
+				for (; s && *s; s++, count++) putchar(*s < 0x80 ? *s : '?');
+				break;
+			}
+			case 'a':
+				count += printf("%s", va_arg(args, char *));
+				break;
+			case 'c':
+				putchar(va_arg(args, int));
+				count++;
+				break;
+			case 'd':
+				count += printf("%ld", (long)va_arg(args, INTN));
+				break;
+			case 'u':
+				count += printf("%lu", (unsigned long)va_arg(args, UINTN));
+				break;
+			case 'x':
+			case 'X':
+				count += printf("%lx", (unsigned long)va_arg(args, UINTN));
+				break;
+			case 'r':
+				count += printf("status %#lx", (unsigned long)va_arg(args, EFI_STATUS));
+				break;
+			case '%':
+				putchar('%');
+				count++;
+				break;
+			default:
+				format--;
+				break;
+		}
+	}
+	va_end(args);
+	return count;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Boot services
+#endif
+static EFI_TPL EFIAPI HostRaiseTPL(EFI_TPL tpl) {
+	EFI_TPL old = host_counters.tpl;
+	
+	host_counters.tpl = tpl;
+	return old;
+}
+
+static VOID EFIAPI HostRestoreTPL(EFI_TPL tpl) {
+	host_counters.tpl = tpl;
+}
+
+static EFI_STATUS EFIAPI HostAllocatePages(EFI_ALLOCATE_TYPE type, EFI_MEMORY_TYPE memory_type, UINTN pages, EFI_PHYSICAL_ADDRESS *address) {
+	VOID *p;
+	
+	(void)memory_type;
+	if (type != AllocateAnyPages) {
+		return EFI_UNSUPPORTED;
+	}
+	
+	if (posix_memalign(&p, EFI_PAGE_SIZE, pages * EFI_PAGE_SIZE) != 0) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	*address = (EFI_PHYSICAL_ADDRESS)(UINTN)p;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostFreePages(EFI_PHYSICAL_ADDRESS address, UINTN pages) {
+	(void)pages;
+	free((VOID *)(UINTN)address);
+	return EFI_SUCCESS;
+}
+
+/* There are no timers or asynchronous reads on the host. */
+static EFI_STATUS EFIAPI HostCreateEvent(UINT32 type, EFI_TPL tpl, EFI_EVENT_NOTIFY notify, VOID *context, EFI_EVENT *event) {
+	(void)type; (void)tpl; (void)notify; (void)context; (void)event;
+	return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI HostWaitForEvent(UINTN count, EFI_EVENT *events, UINTN *index) {
+	(void)count; (void)events; (void)index;
+	return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI HostCloseEvent(EFI_EVENT event) {
+	(void)event;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostHandleProtocol(EFI_HANDLE handle, EFI_GUID *protocol, VOID **interface) {
+	(void)handle; (void)protocol; (void)interface;
+	return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI HostStall(UINTN microseconds) {
+	usleep(microseconds);
+	return EFI_SUCCESS;
+}
+
+static EFI_BOOT_SERVICES host_boot_services = {
+	.RaiseTPL = HostRaiseTPL,
+	.RestoreTPL = HostRestoreTPL,
+	.AllocatePages = HostAllocatePages,
+	.FreePages = HostFreePages,
+	.CreateEvent = HostCreateEvent,
+	.WaitForEvent = HostWaitForEvent,
+	.CloseEvent = HostCloseEvent,
+	.HandleProtocol = HostHandleProtocol,
+	.Stall = HostStall,
+};
+
+#ifdef __APPLE__
+	#pragma mark - Variables
+#endif
+typedef struct HostVariable {
+	EFI_GUID guid;
+	CHAR16 *name;
+	UINT32 attributes;
+	UINTN size;
+	UINT8 *data;
+	struct HostVariable *next;
+} HostVariable;
+
+static HostVariable *host_variables = NULL;
+
+static HostVariable **HostFindVariable(CHAR16 *name, EFI_GUID *guid) {
+	HostVariable **link;
+	
+	for (link = &host_variables; *link; link = &(*link)->next) {
+		if (memcmp(&(*link)->guid, guid, sizeof(EFI_GUID)) == 0 && StrCmp((*link)->name, name) == 0) {
+			break;
+		}
+	}
+	return link;
+}
+
+static EFI_STATUS EFIAPI HostGetVariable(CHAR16 *name, EFI_GUID *guid, UINT32 *attributes, UINTN *size, VOID *data) {
+	HostVariable *variable = *HostFindVariable(name, guid);
+	
+	if (!variable) {
+		return EFI_NOT_FOUND;
+	}
+	
+	if (attributes) {
+		*attributes = variable->attributes;
+	}
+	if (*size < variable->size) {
+		*size = variable->size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	
+	*size = variable->size;
+	memcpy(data, variable->data, variable->size);
+	return EFI_SUCCESS;
+}
+
+/* Variables live in malloc'd memory of their own, so they don't count as allocations. */
+static EFI_STATUS EFIAPI HostSetVariable(CHAR16 *name, EFI_GUID *guid, UINT32 attributes, UINTN size, VOID *data) {
+	HostVariable **link = HostFindVariable(name, guid);
+	HostVariable *variable = *link;
+	
+	host_counters.variable_writes++;
+	if (size == 0) {
+		if (!variable) {
+			return EFI_NOT_FOUND;
+		}
+		
+		*link = variable->next;
+		free(variable->name);
+		free(variable->data);
+		free(variable);
+		return EFI_SUCCESS;
+	}
+	
+	if (!variable) {
+		UINTN name_size = (StrLen(name) + 1) * sizeof(CHAR16);
+		variable = calloc(1, sizeof(HostVariable));
+		if (!variable || !(variable->name = malloc(name_size))) {
+			free(variable);
+			return EFI_OUT_OF_RESOURCES;
+		}
+		
+		memcpy(variable->name, name, name_size);
+		variable->guid = *guid;
+		variable->next = host_variables;
+		host_variables = variable;
+	}
+	
+	UINT8 *copy = malloc(size);
+	if (!copy) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	memcpy(copy, data, size);
+	free(variable->data);
+	variable->data = copy;
+	variable->size = size;
+	variable->attributes = attributes;
+	return EFI_SUCCESS;
+}
+
+static EFI_RUNTIME_SERVICES host_runtime_services = {
+	.GetVariable = HostGetVariable,
+	.SetVariable = HostSetVariable,
+};
+
+#ifdef __APPLE__
+	#pragma mark - Files
+#endif
+typedef struct {
+	EFI_FILE file; // Has to come first.
+	char *root; // The directory that stands for the volume, without a trailing slash.
+	char *path; // Relative to root, starting with a slash, or empty for the root itself.
+	int fd;
+} HostFile;
+
+static EFI_FILE host_file_template;
+
+static EFI_FILE_HANDLE HostFileOpenPath(const char *root, const char *path) {
+	HostFile *file = calloc(1, sizeof(HostFile));
+	char *full;
+	
+	if (!file) {
+		return NULL;
+	}
+	
+	file->root = strdup(root);
+	file->path = strdup(path);
+	full = malloc(strlen(root) + strlen(path) + 1);
+	if (!file->root || !file->path || !full) {
+		goto fail;
+	}
+	
+	sprintf(full, "%s%s", root, path);
+	file->fd = open(full, O_RDONLY);
+	free(full);
+	if (file->fd < 0) {
+		goto fail;
+	}
+	
+	file->file = host_file_template;
+	host_counters.file_opens++;
+	return &file->file;
+	
+fail:
+	free(file->root);
+	free(file->path);
+	free(file);
+	return NULL;
+}
+
+/* Follows the firmware: a leading backslash starts from the root, and . and .. work. */
+static EFI_STATUS EFIAPI HostFileOpen(EFI_FILE_HANDLE self, EFI_FILE_HANDLE *out, CHAR16 *name, UINT64 mode, UINT64 attributes) {
+	HostFile *dir = (HostFile *)self;
+	UINTN length = StrLen(name), start, i;
+	char *path, *end;
+	
+	(void)attributes;
+	if (mode != EFI_FILE_MODE_READ) {
+		return EFI_WRITE_PROTECTED;
+	}
+	
+	path = malloc(strlen(dir->path) + length + 2);
+	if (!path) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	strcpy(path, name[0] == '\\' ? "" : dir->path);
+	end = path + strlen(path);
+	for (start = 0; start <= length; start = i + 1) {
+		for (i = start; i < length && name[i] != '\\'; i++);
+		
+		if (i == start || (i == start + 1 && name[start] == '.')) {
+			continue;
+		} else if (i == start + 2 && name[start] == '.' && name[start + 1] == '.') {
+			while (end > path && *--end != '/');
+			*end = '\0';
+			continue;
+		}
+		
+		*end++ = '/';
+		for (; start < i; start++) {
+			*end++ = name[start] < 0x80 ? (char)name[start] : '?';
+		}
+		*end = '\0';
+	}
+	
+	*out = HostFileOpenPath(dir->root, path);
+	free(path);
+	return *out ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+static EFI_STATUS EFIAPI HostFileClose(EFI_FILE_HANDLE self) {
+	HostFile *file = (HostFile *)self;
+	
+	close(file->fd);
+	free(file->root);
+	free(file->path);
+	free(file);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostFileRead(EFI_FILE_HANDLE self, UINTN *size, VOID *buffer) {
+	HostFile *file = (HostFile *)self;
+	UINTN done = 0;
+	ssize_t got;
+	
+	host_counters.file_reads++;
+	while (done < *size) {
+		got = read(file->fd, (UINT8 *)buffer + done, *size - done);
+		if (got < 0) {
+			return EFI_DEVICE_ERROR;
+		} else if (got == 0) {
+			break;
+		}
+		done += got;
+	}
+	
+	*size = done;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostFileGetPosition(EFI_FILE_HANDLE self, UINT64 *position) {
+	off_t offset = lseek(((HostFile *)self)->fd, 0, SEEK_CUR);
+	
+	if (offset < 0) {
+		return EFI_DEVICE_ERROR;
+	}
+	*position = offset;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostFileSetPosition(EFI_FILE_HANDLE self, UINT64 position) {
+	HostFile *file = (HostFile *)self;
+	off_t offset = position == ~0ULL ? lseek(file->fd, 0, SEEK_END) : lseek(file->fd, position, SEEK_SET);
+	
+	return offset < 0 ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostFileGetInfo(EFI_FILE_HANDLE self, EFI_GUID *type, UINTN *size, VOID *buffer) {
+	HostFile *file = (HostFile *)self;
+	const char *name = strrchr(file->path, '/');
+	UINTN needed, i;
+	EFI_FILE_INFO *info = buffer;
+	struct stat s;
+	
+	if (memcmp(type, &GenericFileInfo, sizeof(EFI_GUID)) != 0) {
+		return EFI_UNSUPPORTED;
+	}
+	
+	name = name ? name + 1 : "";
+	needed = SIZE_OF_EFI_FILE_INFO + (strlen(name) + 1) * sizeof(CHAR16);
+	if (*size < needed) {
+		*size = needed;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	
+	if (fstat(file->fd, &s) != 0) {
+		return EFI_DEVICE_ERROR;
+	}
+	
+	memset(info, 0, needed);
+	info->Size = needed;
+	info->FileSize = S_ISDIR(s.st_mode) ? 0 : (UINT64)s.st_size;
+	info->PhysicalSize = (UINT64)s.st_blocks * 512;
+	info->Attribute = S_ISDIR(s.st_mode) ? EFI_FILE_DIRECTORY : 0;
+	for (i = 0; name[i]; i++) {
+		info->FileName[i] = (UINT8)name[i];
+	}
+	
+	*size = needed;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostFileUnsupported(EFI_FILE_HANDLE self) {
+	(void)self;
+	return EFI_UNSUPPORTED;
+}
+
+static EFI_FILE host_file_template = {
+	.Revision = EFI_FILE_HANDLE_REVISION,
+	.Open = HostFileOpen,
+	.Close = HostFileClose,
+	.Delete = HostFileUnsupported,
+	.Read = HostFileRead,
+	.GetPosition = HostFileGetPosition,
+	.SetPosition = HostFileSetPosition,
+	.GetInfo = HostFileGetInfo,
+	.Flush = HostFileUnsupported,
+};
+
+EFI_FILE_HANDLE HostOpenRoot(const char *directory) {
+	char *root = strdup(directory);
+	EFI_FILE_HANDLE handle;
+	UINTN length;
+	
+	if (!root) {
+		return NULL;
+	}
+	
+	for (length = strlen(root); length > 1 && root[length - 1] == '/'; length--) {
+		root[length - 1] = '\0';
+	}
+	
+	handle = HostFileOpenPath(root, "");
+	free(root);
+	return handle;
+}
+
+EFI_FILE_INFO *LibFileInfo(EFI_FILE_HANDLE handle) {
+	EFI_FILE_INFO *info = NULL;
+	UINTN size = 0;
+	EFI_STATUS err;
+	
+	err = handle->GetInfo(handle, &GenericFileInfo, &size, NULL);
+	if (err != EFI_BUFFER_TOO_SMALL || !(info = AllocatePool(size))) {
+		return NULL;
+	}
+	
+	err = handle->GetInfo(handle, &GenericFileInfo, &size, info);
+	if (EFI_ERROR(err)) {
+		FreePool(info);
+		return NULL;
+	}
+	
+	return info;
+}
+
+#ifdef __APPLE__
+	#pragma mark - System table
+#endif
+static EFI_STATUS EFIAPI HostOutputString(SIMPLE_TEXT_OUTPUT_INTERFACE *self, CHAR16 *string) {
+	(void)self;
+	Print(L"%s", string);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostSetAttribute(SIMPLE_TEXT_OUTPUT_INTERFACE *self, UINTN attribute) {
+	(void)self;
+	(void)attribute;
+	return EFI_SUCCESS;
+}
+
+static SIMPLE_TEXT_OUTPUT_INTERFACE host_console = {
+	.OutputString = HostOutputString,
+	.SetAttribute = HostSetAttribute,
+};
+
+static EFI_SYSTEM_TABLE host_system_table = {
+	.FirmwareVendor = L"Host",
+	.ConOut = &host_console,
+	.RuntimeServices = &host_runtime_services,
+	.BootServices = &host_boot_services,
+};
+
+EFI_SYSTEM_TABLE *ST = &host_system_table;
+EFI_BOOT_SERVICES *BS = &host_boot_services;
+EFI_RUNTIME_SERVICES *RT = &host_runtime_services;
@@ -0,0 +1,409 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "utils.h"
+#include "distribution.h"
+#include "variables.h"
+
+/*
+ * Unit tests of the parsing and string code, run on the host by "make test". Every
+ * CHECK that fails is reported with its line, and the program exits with the number
+ * of failures.
+ */
+static UINTN failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++; \
+		} \
+	} while (0)
+
+static char directory[] = "/tmp/enterprise-tests-XXXXXX";
+static EFI_FILE_HANDLE root;
+
+static VOID WriteFile(const char *name, const char *contents, size_t length) {
+	char path[256];
+	FILE *file;
+	
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	file = fopen(path, "wb");
+	if (!file || fwrite(contents, 1, length, file) != length) {
+		perror(path);
+		exit(1);
+	}
+	fclose(file);
+}
+
+static VOID RemoveFile(const char *name) {
+	char path[256];
+	
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	unlink(path);
+}
+
+static VOID MakeDirectory(const char *name) {
+	char path[256];
+	
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	mkdir(path, 0700);
+}
+
+static VOID RemoveDirectory(const char *name) {
+	char path[256];
+	
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+	rmdir(path);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Configuration files
+#endif
+static VOID TestConfigurationParsing(VOID) {
+	CHAR8 config[] =
+		"# A comment\r\n"
+		"\r\n"
+		"entry Ubuntu 14.04\r\n"
+		"  family   Ubuntu\t \n"
+		"\t \n"
+		"lonely\n"
+		"\tiso \t /ubuntu.iso\n"
+		"   # indented comment\n"
+		"kernel vmlinuz quiet splash";
+	CHAR8 *key, *value;
+	UINTN pos = 0;
+	
+	CHECK(GetConfigurationKeyAndValue(config, &pos, &key, &value) != NULL);
+	CHECK(strcmpa(key, (CHAR8 *)"entry") == 0);
+	CHECK(strcmpa(value, (CHAR8 *)"Ubuntu 14.04") == 0);
+	
+	// Leading and trailing blanks go, and so do lines of nothing but blanks.
+	CHECK(GetConfigurationKeyAndValue(config, &pos, &key, &value) != NULL);
+	CHECK(strcmpa(key, (CHAR8 *)"family") == 0);
+	CHECK(strcmpa(value, (CHAR8 *)"Ubuntu") == 0);
+	
+	// Keys without a value are skipped.
+	CHECK(GetConfigurationKeyAndValue(config, &pos, &key, &value) != NULL);
+	CHECK(strcmpa(key, (CHAR8 *)"iso") == 0);
+	CHECK(strcmpa(value, (CHAR8 *)"/ubuntu.iso") == 0);
+	
+	// The last line doesn't need a newline, and the value keeps its inner spaces.
+	CHECK(GetConfigurationKeyAndValue(config, &pos, &key, &value) != NULL);
+	CHECK(strcmpa(key, (CHAR8 *)"kernel") == 0);
+	CHECK(strcmpa(value, (CHAR8 *)"vmlinuz quiet splash") == 0);
+	
+	CHECK(GetConfigurationKeyAndValue(config, &pos, &key, &value) == NULL);
+	CHECK(GetConfigurationKeyAndValue(config, &pos, &key, &value) == NULL);
+}
+
+static VOID TestConfigurationEdgeCases(VOID) {
+	CHAR8 empty[] = "";
+	CHAR8 blanks[] = "    ";
+	CHAR8 comments[] = "#a\n#b\r\n";
+	CHAR8 *key, *value;
+	UINTN pos = 0;
+	
+	CHECK(GetConfigurationKeyAndValue(empty, &pos, &key, &value) == NULL);
+	pos = 0;
+	CHECK(GetConfigurationKeyAndValue(blanks, &pos, &key, &value) == NULL);
+	pos = 0;
+	CHECK(GetConfigurationKeyAndValue(comments, &pos, &key, &value) == NULL);
+	CHECK(pos == sizeof(comments) - 1);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Strings
+#endif
+static VOID TestStringScanning(VOID) {
+	CHAR8 buffer[80];
+	UINTN offset, length;
+	
+	// Every alignment and length, so that the match and the terminator fall in every
+	// position of a word.
+	for (offset = 0; offset < sizeof(UINTN); offset++) {
+		for (length = 0; length < 40; length++) {
+			CHAR8 *s = buffer + offset;
+			memset(s, 'a', length);
+			s[length] = '\0';
+			
+			CHECK(strchra(s, 'b') == NULL);
+			CHECK(strchra(s, '\0') == s + length);
+			CHECK(strposa(s, 'b') == -1);
+			if (length > 0) {
+				s[length - 1] = 'b';
+				CHECK(strchra(s, 'b') == s + length - 1);
+				CHECK(strposa(s, 'b') == (INTN)length - 1);
+				s[0] = 'b';
+				CHECK(strchra(s, 'b') == s);
+			}
+		}
+	}
+	
+	// Bytes with the high bit set are characters like any other.
+	CHECK(strposa((CHAR8 *)"caf\xc3\xa9 au lait", (char)0xa9) == 4);
+	CHECK(strposa((CHAR8 *)"caf\xc3\xa9 au lait", ' ') == 5);
+}
+
+static VOID TestConversions(VOID) {
+	CHAR16 *wide;
+	CHAR8 *narrow;
+	UINTN before = host_counters.allocations, length;
+	CHAR8 text[] = "the quick brown fox jumps over the lazy dog, 0123456789";
+	
+	// ASCII of every length survives the round trip.
+	for (length = 0; length < sizeof(text); length++) {
+		wide = ASCIItoUTF16(text, length);
+		CHECK(wide != NULL && StrLen(wide) == length);
+		CHECK(wide != NULL && wide[0] == (length ? 't' : 0));
+		
+		narrow = UTF16toASCII(wide, length + 1);
+		CHECK(narrow != NULL && strncmp((char *)narrow, (char *)text, length) == 0 && narrow[length] == '\0');
+		FreePool(narrow);
+		FreePool(wide);
+	}
+	
+	// UTF-8 becomes single characters, also in the middle of runs of ASCII.
+	wide = ASCIItoUTF16((CHAR8 *)"abcdefgh\xc3\xa9ijklmnop\xe2\x82\xac", 22);
+	CHECK(StrLen(wide) == 18);
+	CHECK(wide[8] == 0xe9);
+	CHECK(wide[9] == 'i');
+	CHECK(wide[17] == 0x20ac);
+	
+	// Narrowing stops at the terminator and drops the high byte of anything else.
+	narrow = UTF16toASCII(wide, StrLen(wide) + 1);
+	CHECK(strncmp((char *)narrow, "abcdefgh\xe9ijklmnop\xac", 18) == 0);
+	CHECK(narrow[18] == '\0');
+	FreePool(narrow);
+	
+	wide[4] = '\0';
+	narrow = UTF16toASCII(wide, 18);
+	CHECK(strcmp((char *)narrow, "abcd") == 0);
+	FreePool(narrow);
+	FreePool(wide);
+	
+	wide = GRUBPathToEFIPath((CHAR8 *)"/boot/iso/ubuntu.iso");
+	CHECK(StrCmp(wide, L"\\boot\\iso\\ubuntu.iso") == 0);
+	FreePool(wide);
+	
+	CHECK(host_counters.allocations == before);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Files
+#endif
+static VOID TestFileRead(VOID) {
+	static const char contents[] = "entry Test\nfamily Debian\n";
+	CHAR8 *buffer = NULL;
+	EFI_FILE_INFO info;
+	UINTN length;
+	
+	WriteFile("test.cfg", contents, sizeof(contents) - 1);
+	
+	// The metadata is copied out, so it outlives anything the cache does afterwards.
+	CHECK(!EFI_ERROR(FileCacheGetInfo(root, L"\\test.cfg", &info)));
+	FileCacheFlush();
+	CHECK(info.FileSize == sizeof(contents) - 1);
+	CHECK(FileCacheGetInfo(root, L"\\missing.cfg", &info) == EFI_NOT_FOUND);
+	
+	length = FileRead(root, L"\\test.cfg", &buffer);
+	CHECK(length == sizeof(contents) - 1);
+	CHECK(buffer && memcmp(buffer, contents, length) == 0 && buffer[length] == '\0');
+	FreePool(buffer);
+	
+	CHECK(FileExists(root, L"\\test.cfg"));
+	CHECK(FileExists(root, L"\\sub\\..\\test.cfg"));
+	CHECK(!FileExists(root, L"\\missing.cfg"));
+	
+	buffer = NULL;
+	CHECK(FileRead(root, L"\\missing.cfg", &buffer) == 0);
+	CHECK(buffer == NULL);
+	
+	// Metadata is cached until it is invalidated.
+	RemoveFile("test.cfg");
+	CHECK(FileExists(root, L"\\test.cfg"));
+	FileCacheInvalidate(root, L"\\test.cfg");
+	CHECK(!FileExists(root, L"\\test.cfg"));
+	
+	// Invalidating a directory forgets the files below it, but not its neighbours.
+	MakeDirectory("cached");
+	WriteFile("cached/a.cfg", contents, sizeof(contents) - 1);
+	WriteFile("cachedx.cfg", contents, sizeof(contents) - 1);
+	CHECK(FileExists(root, L"\\cached\\a.cfg"));
+	CHECK(FileExists(root, L"\\cachedx.cfg"));
+	RemoveFile("cached/a.cfg");
+	RemoveFile("cachedx.cfg");
+	FileCacheInvalidateDirectory(root, L"\\CACHED");
+	CHECK(!FileExists(root, L"\\cached\\a.cfg"));
+	CHECK(FileExists(root, L"\\cachedx.cfg"));
+	RemoveDirectory("cached");
+	FileCacheFlush();
+	CHECK(host_counters.tpl == TPL_APPLICATION);
+}
+
+static EFI_STATUS EFIAPI CompareChunk(CHAR8 *chunk, UINTN length, UINT64 offset, VOID *context) {
+	if (memcmp(chunk, (CHAR8 *)context + offset, length) != 0) {
+		return EFI_DEVICE_ERROR;
+	}
+	return EFI_SUCCESS;
+}
+
+static VOID TestFileStream(VOID) {
+	UINTN size = 3 * EFI_PAGE_SIZE + 123, i;
+	CHAR8 *contents = malloc(size), *copy = malloc(size);
+	FileStream *stream;
+	
+	for (i = 0; i < size; i++) {
+		contents[i] = (CHAR8)(i * 7);
+	}
+	WriteFile("stream.bin", (char *)contents, size);
+	
+	CHECK(!EFI_ERROR(FileStreamOpen(root, L"\\stream.bin", NULL, EFI_PAGE_SIZE, &stream)));
+	CHECK(FileStreamSize(stream) == size);
+	CHECK(!EFI_ERROR(FileStreamRead(stream, CompareChunk, contents)));
+	FileStreamClose(stream);
+	
+	CHECK(!EFI_ERROR(FileStreamOpen(root, L"\\stream.bin", NULL, 0, &stream)));
+	CHECK(!EFI_ERROR(FileStreamReadInto(stream, copy, size)));
+	CHECK(memcmp(copy, contents, size) == 0);
+	FileStreamClose(stream);
+	
+	// Chunks already read ahead are handed out first, even when only part of one is needed.
+	memset(copy, 0, size);
+	CHECK(!EFI_ERROR(FileStreamOpen(root, L"\\stream.bin", NULL, EFI_PAGE_SIZE, &stream)));
+	CHECK(!EFI_ERROR(FileStreamStart(stream)));
+	CHECK(!EFI_ERROR(FileStreamReadInto(stream, copy, 100)));
+	CHECK(!EFI_ERROR(FileStreamReadInto(stream, copy + 100, size - 100)));
+	CHECK(memcmp(copy, contents, size) == 0);
+	CHECK(FileStreamReadInto(stream, copy, 1) == EFI_END_OF_FILE);
+	FileStreamClose(stream);
+	
+	// A file that gets shorter while it is read is an error, not an early end.
+	CHECK(!EFI_ERROR(FileStreamOpen(root, L"\\stream.bin", NULL, EFI_PAGE_SIZE, &stream)));
+	WriteFile("stream.bin", (char *)contents, EFI_PAGE_SIZE + 10);
+	CHECK(FileStreamRead(stream, CompareChunk, contents) == EFI_VOLUME_CORRUPTED);
+	FileStreamClose(stream);
+	
+	RemoveFile("stream.bin");
+	FileCacheFlush();
+	free(contents);
+	free(copy);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Variables
+#endif
+static VOID TestVariables(VOID) {
+	static const EFI_GUID guid = { 0x12345678, 0x1234, 0x1234, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+	CHAR8 *value;
+	UINTN size, writes = host_counters.variable_writes;
+	
+	CHECK(VariableGet(&guid, L"Missing", &value, &size) == EFI_NOT_FOUND);
+	
+	// Volatile variables are written straight away.
+	CHECK(!EFI_ERROR(VariableSet(&guid, L"Volatile", (CHAR8 *)"1", 2, FALSE)));
+	CHECK(host_counters.variable_writes == writes + 1);
+	
+	// Non-volatile ones are written once, when flushed, however often they changed.
+	CHECK(!EFI_ERROR(VariableSet(&guid, L"Persistent", (CHAR8 *)"a", 2, TRUE)));
+	CHECK(!EFI_ERROR(VariableSet(&guid, L"Persistent", (CHAR8 *)"bb", 3, TRUE)));
+	CHECK(host_counters.variable_writes == writes + 1);
+	CHECK(!EFI_ERROR(VariableGet(&guid, L"Persistent", &value, &size)));
+	CHECK(size == 3 && strcmpa(value, (CHAR8 *)"bb") == 0);
+	
+	VariableFlush();
+	CHECK(host_counters.variable_writes == writes + 2);
+	VariableFlush();
+	CHECK(host_counters.variable_writes == writes + 2);
+	
+	// What reached the firmware can be read back past the cache.
+	value = NULL;
+	CHECK(!EFI_ERROR(efi_get_variable(&guid, L"Persistent", &value, &size, NULL)));
+	CHECK(value && size == 3 && strcmpa(value, (CHAR8 *)"bb") == 0);
+	FreePool(value);
+	
+	// Unchanged values aren't written at all.
+	CHECK(!EFI_ERROR(VariableSet(&guid, L"Persistent", (CHAR8 *)"bb", 3, TRUE)));
+	VariableFlush();
+	CHECK(host_counters.variable_writes == writes + 2);
+	
+	CHECK(!EFI_ERROR(VariableDelete(&guid, L"Persistent")));
+	CHECK(VariableGet(&guid, L"Persistent", &value, &size) == EFI_NOT_FOUND);
+	VariableFlush();
+	CHECK(efi_get_variable(&guid, L"Persistent", &value, &size, NULL) == EFI_NOT_FOUND);
+	
+	// Variables already stored before they are first looked at aren't rewritten either.
+	writes = host_counters.variable_writes;
+	CHECK(!EFI_ERROR(efi_set_variable(&guid, L"Stored", (CHAR8 *)"cc", 3, TRUE)));
+	CHECK(!EFI_ERROR(VariableGet(&guid, L"Stored", &value, &size)));
+	CHECK(!EFI_ERROR(VariableSet(&guid, L"Stored", (CHAR8 *)"cc", 3, TRUE)));
+	VariableFlush();
+	CHECK(host_counters.variable_writes == writes + 1);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Distributions
+#endif
+static VOID TestDistributions(VOID) {
+	CHAR8 *folder = NULL;
+	
+	CHECK(strcmpa(KernelLocationForDistributionName((CHAR8 *)"Ubuntu", &folder), (CHAR8 *)"/casper/vmlinuz.efi") == 0);
+	CHECK(folder && strcmpa(folder, (CHAR8 *)"casper") == 0);
+	CHECK(strcmpa(InitRDLocationForDistributionName((CHAR8 *)"Debian"), (CHAR8 *)"/live/initrd.img") == 0);
+	CHECK(strcmpa(ISOScanParameterForDistributionName((CHAR8 *)"Debian"), (CHAR8 *)"findiso=") == 0);
+	CHECK(strlena(KernelLocationForDistributionName((CHAR8 *)"Gentoo", &folder)) == 0);
+	
+	CHECK(strcmpa(DistributionFamilyForFileName((CHAR8 *)"UBUNTU-14.04-desktop.iso"), (CHAR8 *)"Ubuntu") == 0);
+	CHECK(strcmpa(DistributionFamilyForFileName((CHAR8 *)"debian-live.iso"), (CHAR8 *)"Debian") == 0);
+	CHECK(DistributionFamilyForFileName((CHAR8 *)"fedora.iso") == NULL);
+}
+
+int main(void) {
+	if (!mkdtemp(directory) || !(root = HostOpenRoot(directory))) {
+		perror(directory);
+		return 1;
+	}
+	
+	TestConfigurationParsing();
+	TestConfigurationEdgeCases();
+	TestStringScanning();
+	TestConversions();
+	TestFileRead();
+	TestFileStream();
+	TestVariables();
+	TestDistributions();
+	
+	root->Close(root);
+	rmdir(directory);
+	
+	if (failures) {
+		fprintf(stderr, "%lu checks failed\n", (unsigned long)failures);
+		return 1;
+	}
+	printf("All tests passed.\n");
+	return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "iso9660.h"
+
+/*
+ * Just enough of ISO 9660 to find where a file is stored inside an image, so that it can
+ * be read straight out of the ISO file. Names are matched against the plain ISO 9660
+ * names, ignoring case and the version suffix; Rock Ridge and Joliet aren't needed for
+ * the kernel and initrd paths of the distributions we support.
+ */
+#define ISO9660_VOLUME_DESCRIPTOR_START 16
+#define ISO9660_ROOT_RECORD_OFFSET 156
+
+#define RECORD_LENGTH 0
+#define RECORD_EXTENT 2
+#define RECORD_DATA_LENGTH 10
+#define RECORD_FLAGS 25
+#define RECORD_NAME_LENGTH 32
+#define RECORD_NAME 33
+#define RECORD_FLAG_DIRECTORY 0x02
+
+static UINT32 ReadLittleEndian32(UINT8 *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT32)p[3] << 24);
+}
+
+/* Reads length bytes at the given byte offset of the image. */
+EFI_STATUS ISO9660ReadAt(EFI_FILE_HANDLE iso, UINT64 offset, UINTN length, VOID *buffer) {
+	EFI_STATUS err;
+	UINTN read_size = length;
+	
+	err = uefi_call_wrapper(iso->SetPosition, 2, iso, offset);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	err = uefi_call_wrapper(iso->Read, 3, iso, &read_size, buffer);
+	if (!EFI_ERROR(err) && read_size != length) {
+		err = EFI_VOLUME_CORRUPTED;
+	}
+	
+	return err;
+}
+
+/*
+ * Compares a path component with the name in a directory record, ignoring case, the
+ * ";1" version suffix and the trailing dot of names without an extension.
+ */
+static BOOLEAN NameMatches(CHAR8 *component, UINTN component_length, UINT8 *name, UINTN name_length) {
+	UINTN i;
+	
+	for (i = 0; i < name_length; i++) {
+		if (name[i] == ';') {
+			name_length = i;
+			break;
+		}
+	}
+	
+	if (name_length > 0 && name[name_length - 1] == '.') {
+		name_length--;
+	}
+	
+	if (name_length != component_length) {
+		return FALSE;
+	}
+	
+	for (i = 0; i < name_length; i++) {
+		CHAR8 a = component[i], b = name[i];
+		if (a >= 'a' && a <= 'z') a -= 'a' - 'A';
+		if (b >= 'a' && b <= 'z') b -= 'a' - 'A';
+		if (a != b) {
+			return FALSE;
+		}
+	}
+	
+	return TRUE;
+}
+
+/*
+ * Looks for a name in the directory stored at the given extent, and returns the extent
+ * and size of what it refers to.
+ */
+static EFI_STATUS FindInDirectory(EFI_FILE_HANDLE iso, UINT32 extent, UINT32 size, CHAR8 *component,
+	UINTN component_length, BOOLEAN want_directory, OUT UINT32 *found_extent, OUT UINT32 *found_size) {
+	UINT8 *sector;
+	EFI_STATUS err = EFI_NOT_FOUND;
+	UINT32 position;
+	
+	sector = AllocatePool(ISO9660_SECTOR_SIZE);
+	if (!sector) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	// Directory records never cross sector boundaries, so look at one sector at a time.
+	for (position = 0; position < size; position += ISO9660_SECTOR_SIZE) {
+		UINTN offset = 0;
+		
+		err = ISO9660ReadAt(iso, ((UINT64)extent * ISO9660_SECTOR_SIZE) + position, ISO9660_SECTOR_SIZE, sector);
+		if (EFI_ERROR(err)) {
+			break;
+		}
+		err = EFI_NOT_FOUND;
+		
+		while (offset + RECORD_NAME < ISO9660_SECTOR_SIZE && sector[offset + RECORD_LENGTH] != 0) {
+			UINT8 *record = sector + offset;
+			UINTN name_length = record[RECORD_NAME_LENGTH];
+			
+			if (offset + record[RECORD_LENGTH] > ISO9660_SECTOR_SIZE || RECORD_NAME + name_length > record[RECORD_LENGTH]) {
+				err = EFI_VOLUME_CORRUPTED;
+				goto out;
+			}
+			
+			if (!!(record[RECORD_FLAGS] & RECORD_FLAG_DIRECTORY) == want_directory &&
+				NameMatches(component, component_length, record + RECORD_NAME, name_length)) {
+				*found_extent = ReadLittleEndian32(record + RECORD_EXTENT);
+				*found_size = ReadLittleEndian32(record + RECORD_DATA_LENGTH);
+				err = EFI_SUCCESS;
+				goto out;
+			}
+			
+			offset += record[RECORD_LENGTH];
+		}
+	}
+	
+out:
+	FreePool(sector);
+	return err;
+}
+
+/*
+ * Finds a file inside an ISO image, given its path with forward slashes, and returns the
+ * byte offset and length of its contents within the image.
+ */
+EFI_STATUS ISO9660FindFile(EFI_FILE_HANDLE iso, CHAR8 *path, OUT UINT64 *offset, OUT UINT64 *length) {
+	UINT8 descriptor[ISO9660_SECTOR_SIZE];
+	UINT32 extent, size;
+	EFI_STATUS err;
+	
+	err = ISO9660ReadAt(iso, ISO9660_VOLUME_DESCRIPTOR_START * ISO9660_SECTOR_SIZE, ISO9660_SECTOR_SIZE, descriptor);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	// We need the primary volume descriptor.
+	if (descriptor[0] != 1 || CompareMem(descriptor + 1, "CD001", 5) != 0) {
+		return EFI_UNSUPPORTED;
+	}
+	
+	extent = ReadLittleEndian32(descriptor + ISO9660_ROOT_RECORD_OFFSET + RECORD_EXTENT);
+	size = ReadLittleEndian32(descriptor + ISO9660_ROOT_RECORD_OFFSET + RECORD_DATA_LENGTH);
+	
+	while (*path) {
+		CHAR8 *component;
+		UINTN component_length = 0;
+		
+		while (*path == '/') {
+			path++;
+		}
+		
+		component = path;
+		while (component[component_length] && component[component_length] != '/') {
+			component_length++;
+		}
+		path += component_length;
+		
+		if (component_length == 0) {
+			break;
+		}
+		
+		// Every component but the last has to be a directory.
+		err = FindInDirectory(iso, extent, size, component, component_length, *path != '\0', &extent, &size);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+	}
+	
+	*offset = (UINT64)extent * ISO9660_SECTOR_SIZE;
+	*length = size;
+	return EFI_SUCCESS;
+}
+
+#define ELTORITO_CATALOG_SECTOR 0x47
+#define ELTORITO_ENTRY_SIZE 32
+#define ELTORITO_PLATFORM_EFI 0xef
+#define ELTORITO_BOOTABLE 0x88
+#define ELTORITO_SECTION_HEADER 0x90
+#define ELTORITO_LAST_SECTION_HEADER 0x91
+
+/*
+ * Works out how large a FAT image is from its boot sector, for El Torito entries that
+ * don't say. Returns zero if it doesn't look like a FAT boot sector.
+ */
+static UINT64 FATImageSize(EFI_FILE_HANDLE iso, UINT64 offset) {
+	UINT8 sector[512];
+	UINT32 sectors;
+	
+	if (EFI_ERROR(ISO9660ReadAt(iso, offset, sizeof(sector), sector)) || sector[510] != 0x55 || sector[511] != 0xaa) {
+		return 0;
+	}
+	
+	sectors = sector[19] | (sector[20] << 8);
+	if (sectors == 0) {
+		sectors = ReadLittleEndian32(sector + 32);
+	}
+	
+	return (UINT64)sectors * (sector[11] | (sector[12] << 8));
+}
+
+/*
+ * Finds the EFI boot image through the El Torito boot catalog, and gives its byte offset
+ * and length within the image. The boot image is a FAT file system with the loader in
+ * \EFI\BOOT.
+ */
+EFI_STATUS ISO9660FindEFIBootImage(EFI_FILE_HANDLE iso, OUT UINT64 *offset, OUT UINT64 *length) {
+	UINT8 sector[ISO9660_SECTOR_SIZE];
+	UINT8 platform;
+	UINTN i, position, entries = 0;
+	EFI_STATUS err;
+	
+	// The boot record comes right after the primary volume descriptor.
+	for (i = ISO9660_VOLUME_DESCRIPTOR_START; ; i++) {
+		err = ISO9660ReadAt(iso, i * ISO9660_SECTOR_SIZE, ISO9660_SECTOR_SIZE, sector);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+		
+		if (CompareMem(sector + 1, "CD001", 5) != 0 || sector[0] == 255) {
+			return EFI_NOT_FOUND;
+		}
+		if (sector[0] == 0 && CompareMem(sector + 7, "EL TORITO SPECIFICATION", 23) == 0) {
+			break;
+		}
+	}
+	
+	err = ISO9660ReadAt(iso, (UINT64)ReadLittleEndian32(sector + ELTORITO_CATALOG_SECTOR) * ISO9660_SECTOR_SIZE,
+		ISO9660_SECTOR_SIZE, sector);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	if (sector[0] != 1 || sector[30] != 0x55 || sector[31] != 0xaa) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+	
+	/*
+	 * The validation entry gives the platform of the default entry that follows it. Each
+	 * section header after that gives the platform of the entries in its section.
+	 */
+	platform = sector[1];
+	for (position = ELTORITO_ENTRY_SIZE; position + ELTORITO_ENTRY_SIZE <= ISO9660_SECTOR_SIZE; position += ELTORITO_ENTRY_SIZE) {
+		UINT8 *entry = sector + position;
+		
+		if (position > ELTORITO_ENTRY_SIZE && entries == 0) {
+			if (entry[0] != ELTORITO_SECTION_HEADER && entry[0] != ELTORITO_LAST_SECTION_HEADER) {
+				break;
+			}
+			platform = entry[1];
+			entries = entry[2] | (entry[3] << 8);
+			continue;
+		}
+		
+		if (entries > 0) {
+			entries--;
+		}
+		if (platform != ELTORITO_PLATFORM_EFI || entry[0] != ELTORITO_BOOTABLE) {
+			continue;
+		}
+		
+		// The length is counted in 512 byte sectors, and often left out for EFI images.
+		*offset = (UINT64)ReadLittleEndian32(entry + 8) * ISO9660_SECTOR_SIZE;
+		*length = (UINT64)(entry[6] | (entry[7] << 8)) * 512;
+		if (*length <= 512) {
+			*length = FATImageSize(iso, *offset);
+		}
+		
+		return *length > 0 ? EFI_SUCCESS : EFI_VOLUME_CORRUPTED;
+	}
+	
+	return EFI_NOT_FOUND;
+}
@@ -0,0 +1,30 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _iso9660_h
+#define _iso9660_h
+
+#define ISO9660_SECTOR_SIZE 2048
+
+EFI_STATUS ISO9660ReadAt(EFI_FILE_HANDLE, UINT64, UINTN, VOID *);
+EFI_STATUS ISO9660FindFile(EFI_FILE_HANDLE, CHAR8 *, OUT UINT64 *, OUT UINT64 *);
+EFI_STATUS ISO9660FindEFIBootImage(EFI_FILE_HANDLE, OUT UINT64 *, OUT UINT64 *);
+
+#endif
@@ -0,0 +1,612 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "catalog.h"
+#include "distribution.h"
+#include "kernelcache.h"
+#include "linux.h"
+#include "validation.h"
+#include "variables.h"
+#include "volumes.h"
+
+/*
+ * Reading the kernel and initrd out of an ISO file is slow, so the first boot of an
+ * entry copies them into their own directory on the boot volume:
+ *
+ *     \efi\enterprise\cache\<fingerprint>\vmlinuz
+ *     \efi\enterprise\cache\<fingerprint>\initrd
+ *
+ * The fingerprint covers the ISO file's location, size and modification time and the
+ * paths of the files inside it, so a changed ISO file simply gets a new directory. The
+ * index file records how large each directory is and when it was last booted; once the
+ * cache grows past its size limit, the least recently booted directories are removed.
+ * Cached kernels are started directly instead of through GRUB, either loaded to where
+ * they want to be by us or through their EFI stub.
+ */
+typedef struct {
+	UINT64 fingerprint;
+	UINT64 size;
+	UINT64 last_booted;
+} KernelCacheIndexEntry;
+
+static EFI_FILE_HANDLE cache_root = NULL;
+static EFI_HANDLE cache_device = NULL;
+static UINT64 cache_size_limit = 0;
+
+static KernelCacheIndexEntry index_entries[KERNEL_CACHE_MAX_ENTRIES];
+static UINTN index_count = 0;
+static BOOLEAN index_dirty = FALSE;
+
+/* Sets up the cache on the given volume. A size limit of zero disables it. */
+VOID InitializeKernelCache(EFI_FILE_HANDLE root, EFI_HANDLE device, UINT64 size_limit) {
+	cache_root = root;
+	cache_device = device;
+	cache_size_limit = size_limit;
+}
+
+BOOLEAN KernelCacheEnabled(VOID) {
+	return cache_root && cache_size_limit > 0;
+}
+
+/* Returns TRUE if the entry has everything needed to be booted from the cache. */
+BOOLEAN KernelCacheCanBoot(LinuxBootOption *option) {
+	return KernelCacheEnabled() && option->volume && option->kernel_path && option->initrd_path &&
+		option->boot_folder && option->distro_family;
+}
+
+static UINT64 ParseHex(CHAR8 *string) {
+	UINT64 value = 0;
+	
+	for (;; string++) {
+		if (*string >= '0' && *string <= '9') {
+			value = (value << 4) | (*string - '0');
+		} else if (*string >= 'a' && *string <= 'f') {
+			value = (value << 4) | (*string - 'a' + 10);
+		} else {
+			return value;
+		}
+	}
+}
+
+static UINT64 ParseDecimal(CHAR8 **string) {
+	UINT64 value = 0;
+	CHAR8 *p = *string;
+	
+	while (*p == ' ') {
+		p++;
+	}
+	while (*p >= '0' && *p <= '9') {
+		value = value * 10 + (*p++ - '0');
+	}
+	
+	*string = p;
+	return value;
+}
+
+static CHAR8* AppendHex(CHAR8 *p, UINT64 value) {
+	INTN shift;
+	
+	for (shift = 60; shift >= 0; shift -= 4) {
+		*p++ = "0123456789abcdef"[(value >> shift) & 0xf];
+	}
+	
+	return p;
+}
+
+static CHAR8* AppendDecimal(CHAR8 *p, UINT64 value) {
+	CHAR8 digits[20];
+	UINTN count = 0;
+	
+	do {
+		digits[count++] = '0' + (value % 10);
+		value /= 10;
+	} while (value > 0);
+	
+	while (count > 0) {
+		*p++ = digits[--count];
+	}
+	
+	return p;
+}
+
+/* Reads the index file; each line holds a fingerprint, a size and a boot counter. */
+static VOID ReadIndex(VOID) {
+	CHAR8 *contents, *key, *value;
+	UINTN position = 0;
+	
+	index_count = 0;
+	index_dirty = FALSE;
+	if (FileRead(cache_root, KERNEL_CACHE_INDEX, &contents) == 0) {
+		return;
+	}
+	
+	while (index_count < KERNEL_CACHE_MAX_ENTRIES &&
+		GetConfigurationKeyAndValue(contents, &position, &key, &value)) {
+		KernelCacheIndexEntry *entry = &index_entries[index_count++];
+		entry->fingerprint = ParseHex(key);
+		entry->size = ParseDecimal(&value);
+		entry->last_booted = ParseDecimal(&value);
+	}
+	
+	FreePool(contents);
+}
+
+/* Opens a file or directory below parent, creating it if it doesn't exist yet. */
+static EFI_STATUS OpenOrCreate(EFI_FILE_HANDLE parent, CHAR16 *name, UINT64 attributes, OUT EFI_FILE_HANDLE *handle) {
+	return uefi_call_wrapper(parent->Open, 5, parent, handle, name,
+		EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE|EFI_FILE_MODE_CREATE, attributes);
+}
+
+/*
+ * Creates an empty file at the given path in the cache volume. An existing file is removed
+ * first, so that nothing of it is left over past the end of what is written now.
+ */
+static EFI_STATUS CreateEmptyFile(CHAR16 *path, OUT EFI_FILE_HANDLE *handle) {
+	if (!EFI_ERROR(OpenOrCreate(cache_root, path, 0, handle))) {
+		uefi_call_wrapper((*handle)->Delete, 1, *handle);
+	}
+	FileCacheInvalidate(cache_root, path);
+	
+	return OpenOrCreate(cache_root, path, 0, handle);
+}
+
+/* Replaces a file with the given contents. */
+static EFI_STATUS WriteWholeFile(CHAR16 *path, VOID *contents, UINTN size) {
+	EFI_FILE_HANDLE handle;
+	EFI_STATUS err;
+	
+	err = CreateEmptyFile(path, &handle);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	err = uefi_call_wrapper(handle->Write, 3, handle, &size, contents);
+	uefi_call_wrapper(handle->Close, 1, handle);
+	return err;
+}
+
+static EFI_STATUS WriteIndex(VOID) {
+	// Each line is at most 16 hex digits, two 20 digit numbers, two spaces and a newline.
+	CHAR8 *contents = AllocatePool(index_count * 60 + 1);
+	CHAR8 *p = contents;
+	EFI_STATUS err;
+	UINTN i;
+	
+	if (!contents) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	for (i = 0; i < index_count; i++) {
+		p = AppendHex(p, index_entries[i].fingerprint);
+		*p++ = ' ';
+		p = AppendDecimal(p, index_entries[i].size);
+		*p++ = ' ';
+		p = AppendDecimal(p, index_entries[i].last_booted);
+		*p++ = '\n';
+	}
+	
+	err = WriteWholeFile(KERNEL_CACHE_INDEX, contents, p - contents);
+	FreePool(contents);
+	return err;
+}
+
+/* Writes the index back, if anything in it has changed since it was read. */
+static VOID FlushIndex(VOID) {
+	if (index_dirty && !EFI_ERROR(WriteIndex())) {
+		index_dirty = FALSE;
+	}
+}
+
+static CHAR16* EntryDirectory(UINT64 fingerprint) {
+	CHAR8 hex[17];
+	
+	*AppendHex(hex, fingerprint) = '\0';
+	return PoolPrint(L"%s\\%a", KERNEL_CACHE_DIRECTORY, hex);
+}
+
+/* Removes a cached kernel and initrd and their directory. */
+static VOID RemoveEntryDirectory(UINT64 fingerprint) {
+	CHAR16 *directory = EntryDirectory(fingerprint);
+	CHAR16 *names[] = {L"vmlinuz", L"initrd", NULL};
+	EFI_FILE_HANDLE handle;
+	UINTN i;
+	
+	if (!directory) {
+		return;
+	}
+	
+	// The cache may still hold the directory open from an earlier lookup.
+	FileCacheInvalidateDirectory(cache_root, directory);
+	for (i = 0; names[i]; i++) {
+		CHAR16 *path = PoolPrint(L"%s\\%s", directory, names[i]);
+		if (path) {
+			if (!EFI_ERROR(uefi_call_wrapper(cache_root->Open, 5, cache_root, &handle, path,
+				EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE, 0))) {
+				uefi_call_wrapper(handle->Delete, 1, handle);
+			}
+			FreePool(path);
+		}
+	}
+	
+	if (!EFI_ERROR(uefi_call_wrapper(cache_root->Open, 5, cache_root, &handle, directory,
+		EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE, 0))) {
+		uefi_call_wrapper(handle->Delete, 1, handle);
+	}
+	FreePool(directory);
+}
+
+/* Removes the least recently booted entries until another size bytes fit in the cache. */
+static BOOLEAN MakeRoom(UINT64 size) {
+	UINT64 used = 0;
+	UINTN i;
+	
+	if (size > cache_size_limit) {
+		return FALSE;
+	}
+	
+	for (i = 0; i < index_count; i++) {
+		used += index_entries[i].size;
+	}
+	
+	while (index_count > 0 && (used + size > cache_size_limit || index_count == KERNEL_CACHE_MAX_ENTRIES)) {
+		UINTN oldest = 0;
+		for (i = 1; i < index_count; i++) {
+			if (index_entries[i].last_booted < index_entries[oldest].last_booted) {
+				oldest = i;
+			}
+		}
+		
+		RemoveEntryDirectory(index_entries[oldest].fingerprint);
+		used -= index_entries[oldest].size;
+		index_entries[oldest] = index_entries[--index_count];
+		index_dirty = TRUE;
+	}
+	
+	return TRUE;
+}
+
+/* Copies a range of the ISO file into a new file in the cache, a chunk at a time. */
+static EFI_STATUS ExtractRange(LinuxBootOption *option, FileRange *range, CHAR16 *directory, CHAR16 *name) {
+	CHAR16 *path = PoolPrint(L"%s\\%s", directory, name);
+	EFI_FILE_HANDLE file;
+	EFI_PHYSICAL_ADDRESS buffer;
+	UINTN pages = EFI_SIZE_TO_PAGES(FILE_STREAM_DEFAULT_CHUNK_SIZE);
+	UINT64 done = 0;
+	EFI_STATUS err;
+	
+	if (!path) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, pages, &buffer);
+	if (EFI_ERROR(err)) {
+		FreePool(path);
+		return err;
+	}
+	
+	err = CreateEmptyFile(path, &file);
+	FreePool(path);
+	if (EFI_ERROR(err)) {
+		uefi_call_wrapper(BS->FreePages, 2, buffer, pages);
+		return err;
+	}
+	
+	while (!EFI_ERROR(err) && done < range->length) {
+		FileRange chunk;
+		UINTN size;
+		
+		chunk.offset = range->offset + done;
+		chunk.length = range->length - done;
+		if (chunk.length > FILE_STREAM_DEFAULT_CHUNK_SIZE) {
+			chunk.length = FILE_STREAM_DEFAULT_CHUNK_SIZE;
+		}
+		
+		err = ReadBootFile(option, &chunk, (VOID *)(UINTN)buffer);
+		if (!EFI_ERROR(err)) {
+			size = (UINTN)chunk.length;
+			err = uefi_call_wrapper(file->Write, 3, file, &size, (VOID *)(UINTN)buffer);
+		}
+		done += chunk.length;
+	}
+	
+	uefi_call_wrapper(BS->FreePages, 2, buffer, pages);
+	if (EFI_ERROR(err)) {
+		uefi_call_wrapper(file->Delete, 1, file);
+	} else {
+		uefi_call_wrapper(file->Close, 1, file);
+	}
+	
+	return err;
+}
+
+/* Copies the kernel and initrd of an entry into a new cache directory. */
+static EFI_STATUS ExtractEntry(LinuxBootOption *option, UINT64 fingerprint, BootFileLocation *location) {
+	CHAR16 *path = EntryDirectory(fingerprint);
+	EFI_FILE_HANDLE handle;
+	EFI_STATUS err;
+	
+	if (!path) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	// Create \efi\enterprise and \efi\enterprise\cache on the way.
+	err = OpenOrCreate(cache_root, L"\\efi\\enterprise", EFI_FILE_DIRECTORY, &handle);
+	if (!EFI_ERROR(err)) {
+		uefi_call_wrapper(handle->Close, 1, handle);
+		err = OpenOrCreate(cache_root, KERNEL_CACHE_DIRECTORY, EFI_FILE_DIRECTORY, &handle);
+	}
+	if (!EFI_ERROR(err)) {
+		uefi_call_wrapper(handle->Close, 1, handle);
+		err = OpenOrCreate(cache_root, path, EFI_FILE_DIRECTORY, &handle);
+	}
+	if (EFI_ERROR(err)) {
+		FreePool(path);
+		return err;
+	}
+	uefi_call_wrapper(handle->Close, 1, handle);
+	
+	if (!headless) {
+		Print(L"Copying the kernel and initrd of %a to the cache...\n", option->name);
+	}
+	err = ExtractRange(option, &location->kernel, path, L"vmlinuz");
+	if (!EFI_ERROR(err)) {
+		err = ExtractRange(option, &location->initrd, path, L"initrd");
+	}
+	
+	FreePool(path);
+	if (EFI_ERROR(err)) {
+		RemoveEntryDirectory(fingerprint);
+	}
+	
+	return err;
+}
+
+/* Checks that an entry's kernel and initrd are still in the cache at the size they were copied at. */
+static BOOLEAN EntryFilesIntact(KernelCacheIndexEntry *entry) {
+	CHAR16 *directory = EntryDirectory(entry->fingerprint);
+	CHAR16 *names[] = {L"vmlinuz", L"initrd", NULL};
+	EFI_FILE_INFO info;
+	BOOLEAN intact = directory != NULL;
+	UINT64 size = 0;
+	UINTN i;
+	
+	for (i = 0; intact && names[i]; i++) {
+		CHAR16 *path = PoolPrint(L"%s\\%s", directory, names[i]);
+		if (!path || EFI_ERROR(FileCacheGetInfo(cache_root, path, &info))) {
+			intact = FALSE;
+		} else {
+			size += info.FileSize;
+		}
+		if (path) {
+			FreePool(path);
+		}
+	}
+	
+	if (directory) {
+		FreePool(directory);
+	}
+	return intact && size == entry->size;
+}
+
+/*
+ * Identifies an entry's kernel and initrd. Returns zero if the entry's ISO file can't be
+ * found.
+ */
+static UINT64 EntryFingerprint(LinuxBootOption *option) {
+	CHAR16 *path = GRUBPathToEFIPath(option->iso_path);
+	EFI_FILE_INFO info;
+	EFI_STATUS err = FileCacheGetInfo(option->volume->root, path, &info);
+	UINT64 hash = HASH_INITIAL_VALUE, mtime;
+	
+	FreePool(path);
+	if (EFI_ERROR(err)) {
+		return 0;
+	}
+	
+	mtime = PackFileTime(&info.ModificationTime);
+	if (option->volume->device_path) {
+		hash = HashBytes(option->volume->device_path, StrSize(option->volume->device_path), hash);
+	}
+	hash = HashBytes(option->iso_path, strlena(option->iso_path) + 1, hash);
+	hash = HashBytes(option->kernel_path, strlena(option->kernel_path) + 1, hash);
+	hash = HashBytes(option->initrd_path, strlena(option->initrd_path) + 1, hash);
+	hash = HashBytes(&info.FileSize, sizeof(info.FileSize), hash);
+	hash = HashBytes(&mtime, sizeof(mtime), hash);
+	
+	return hash ? hash : 1;
+}
+
+/*
+ * Loads the kernel and initrd to where the kernel wants them and starts the kernel. Only
+ * returns if the kernel can't be started that way.
+ */
+static EFI_STATUS StartPlacedKernel(CHAR16 *kernel, CHAR16 *initrd, CHAR16 *parameters) {
+	CHAR8 *cmdline = UTF16toASCII(parameters, StrLen(parameters) + 1);
+	LinuxImage image;
+	EFI_STATUS err;
+	
+	if (!cmdline) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	err = LinuxLoad(cache_root, kernel, initrd, cmdline, &image);
+	FreePool(cmdline);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	if (trace) {
+		Print(L"Loaded the kernel at 0x%lx (%s) and the initrd at 0x%lx, %ld bytes.\n",
+			image.kernel, image.preferred_address ? L"its preferred address" : L"relocated",
+			image.initrd, image.initrd_size);
+	}
+	
+	StopBackgroundValidation();
+	FileCacheFlush();
+	VariableFlush();
+	if (!headless && !trace) {
+		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
+	}
+	err = LinuxStart(&image);
+	LinuxFree(&image);
+	return err;
+}
+
+/* Starts a cached kernel, placing it ourselves or else through its EFI stub. Only returns if that fails. */
+static EFI_STATUS StartCachedKernel(LinuxBootOption *option, UINT64 fingerprint, CHAR8 *kernel_parameters) {
+	CHAR16 *directory = EntryDirectory(fingerprint);
+	CHAR16 *kernel = NULL, *initrd = NULL, *parameters = NULL, *options = NULL;
+	EFI_DEVICE_PATH *path = NULL;
+	EFI_LOADED_IMAGE *loaded_image;
+	EFI_HANDLE image;
+	EFI_STATUS err = EFI_OUT_OF_RESOURCES;
+	
+	if (!directory) {
+		return err;
+	}
+	
+	// Without GRUB, the live system has to be told where its ISO file is by ourselves.
+	kernel = PoolPrint(L"%s\\vmlinuz", directory);
+	initrd = PoolPrint(L"%s\\initrd", directory);
+	parameters = PoolPrint(L"boot=%a %a%a %a", option->boot_folder,
+		ISOScanParameterForDistributionName(option->distro_family), option->iso_path, kernel_parameters);
+	if (!kernel || !initrd || !parameters) {
+		goto out;
+	}
+	
+	// If the kernel can't be placed by us, its EFI stub will have to do.
+	err = StartPlacedKernel(kernel, initrd, parameters);
+	if (trace) {
+		Print(L"Couldn't start the kernel from where we placed it: %r. Using its EFI stub.\n", err);
+	}
+	
+	options = PoolPrint(L"initrd=%s %s", initrd, parameters);
+	path = FileDevicePath(cache_device, kernel);
+	if (!options || !path) {
+		err = EFI_OUT_OF_RESOURCES;
+		goto out;
+	}
+	
+	err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, global_image, path, NULL, 0, &image);
+	if (EFI_ERROR(err)) {
+		goto out;
+	}
+	
+	err = uefi_call_wrapper(BS->HandleProtocol, 3, image, &LoadedImageProtocol, (VOID **)&loaded_image);
+	if (EFI_ERROR(err)) {
+		uefi_call_wrapper(BS->UnloadImage, 1, image);
+		goto out;
+	}
+	loaded_image->LoadOptions = options;
+	loaded_image->LoadOptionsSize = StrSize(options);
+	
+	StopBackgroundValidation();
+	FileCacheFlush();
+	VariableFlush();
+	if (!headless && !trace) {
+		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
+	}
+	err = uefi_call_wrapper(BS->StartImage, 3, image, NULL, NULL);
+	
+out:
+	if (path) FreePool(path);
+	if (options) FreePool(options);
+	if (parameters) FreePool(parameters);
+	if (initrd) FreePool(initrd);
+	if (kernel) FreePool(kernel);
+	FreePool(directory);
+	return err;
+}
+
+/*
+ * Boots an entry from the cache, copying its kernel and initrd there first if this is
+ * the first time it is booted. Returns an error if the entry can't be booted this way,
+ * in which case the caller should go through GRUB as usual.
+ */
+EFI_STATUS BootFromKernelCache(LinuxBootOption *option, CHAR8 *kernel_parameters) {
+	BootFileLocation location;
+	KernelCacheIndexEntry *entry = NULL;
+	UINT64 fingerprint, last_booted = 0;
+	EFI_STATUS err;
+	UINTN i;
+	
+	if (!KernelCacheCanBoot(option)) {
+		return EFI_UNSUPPORTED;
+	}
+	
+	fingerprint = EntryFingerprint(option);
+	if (fingerprint == 0) {
+		return EFI_NOT_FOUND;
+	}
+	
+	ReadIndex();
+	for (i = 0; i < index_count; i++) {
+		if (index_entries[i].fingerprint == fingerprint) {
+			entry = &index_entries[i];
+		}
+		if (index_entries[i].last_booted > last_booted) {
+			last_booted = index_entries[i].last_booted;
+		}
+	}
+	
+	// The files can have been removed or cut short behind our back, for example by a check
+	// of the file system; copy them again in that case.
+	if (entry && !EntryFilesIntact(entry)) {
+		RemoveEntryDirectory(entry->fingerprint);
+		*entry = index_entries[--index_count];
+		index_dirty = TRUE;
+		entry = NULL;
+	}
+	
+	if (!entry) {
+		err = LocateBootFiles(option, &location);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+		
+		if (!MakeRoom(location.kernel.length + location.initrd.length)) {
+			FlushIndex();
+			return EFI_VOLUME_FULL;
+		}
+		
+		err = ExtractEntry(option, fingerprint, &location);
+		if (EFI_ERROR(err)) {
+			FlushIndex(); // Entries may have been evicted already.
+			return err;
+		}
+		
+		entry = &index_entries[index_count++];
+		entry->fingerprint = fingerprint;
+		entry->size = location.kernel.length + location.initrd.length;
+		entry->last_booted = 0;
+	}
+	
+	// Booting the most recently booted entry again doesn't change the order.
+	if (entry->last_booted != last_booted || last_booted == 0) {
+		entry->last_booted = last_booted + 1;
+		index_dirty = TRUE;
+	}
+	FlushIndex();
+	
+	return StartCachedKernel(option, fingerprint, kernel_parameters);
+}
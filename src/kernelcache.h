@@ -0,0 +1,38 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _kernelcache_h
+#define _kernelcache_h
+#include "main.h"
+
+/*
+ * Kernels and initrds extracted from ISO files are kept on the boot volume, one
+ * directory per ISO file and entry, so that later boots can load them as plain files.
+ */
+#define KERNEL_CACHE_DIRECTORY L"\\efi\\enterprise\\cache"
+#define KERNEL_CACHE_INDEX L"\\efi\\enterprise\\cache\\index"
+#define KERNEL_CACHE_MAX_ENTRIES 32
+
+VOID InitializeKernelCache(EFI_FILE_HANDLE, EFI_HANDLE, UINT64);
+BOOLEAN KernelCacheEnabled(VOID);
+BOOLEAN KernelCacheCanBoot(LinuxBootOption *);
+EFI_STATUS BootFromKernelCache(LinuxBootOption *, CHAR8 *);
+
+#endif
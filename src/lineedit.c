@@ -0,0 +1,239 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "menu.h"
+#include "lineedit.h"
+#include "variables.h"
+
+#define LINE_MAX_WIDTH 255
+
+typedef struct {
+	CHAR16 *text; // Holds max_length characters plus the terminator.
+	UINTN max_length;
+	UINTN length;
+	UINTN cursor;
+	UINTN offset; // First character shown on the screen.
+	UINTN column, row, width; // Where the line is shown.
+} LineEditor;
+
+/* Shows the part of the line around the cursor, and puts the cursor in place. */
+static VOID RedrawLine(LineEditor *editor) {
+	CHAR16 visible[LINE_MAX_WIDTH + 1];
+	UINTN i;
+	
+	// Scroll sideways just far enough to keep the cursor in view.
+	if (editor->cursor < editor->offset) {
+		editor->offset = editor->cursor;
+	} else if (editor->cursor >= editor->offset + editor->width) {
+		editor->offset = editor->cursor - editor->width + 1;
+	}
+	
+	// Pad with spaces to wipe out whatever was left from a longer line.
+	for (i = 0; i < editor->width; i++) {
+		visible[i] = editor->offset + i < editor->length ? editor->text[editor->offset + i] : ' ';
+	}
+	visible[editor->width] = '\0';
+	
+	uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, editor->column, editor->row);
+	uefi_call_wrapper(ST->ConOut->OutputString, 2, ST->ConOut, visible);
+	uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut,
+		editor->column + editor->cursor - editor->offset, editor->row);
+}
+
+/* Replaces the whole line, for instance with one from the history. */
+static VOID SetLine(LineEditor *editor, CHAR16 *text) {
+	editor->length = 0;
+	while (text[editor->length] && editor->length < editor->max_length) {
+		editor->text[editor->length] = text[editor->length];
+		editor->length++;
+	}
+	editor->text[editor->length] = '\0';
+	editor->cursor = editor->length;
+}
+
+/*
+ * Returns the history entry with the given index, newest first, or NULL. The variable
+ * holds the entries one after the other, each with its terminator.
+ */
+static CHAR16* HistoryEntry(CHAR16 *history, UINTN size, UINTN index) {
+	UINTN position = 0, length = size / sizeof(CHAR16);
+	
+	while (position < length) {
+		if (index-- == 0) {
+			return history + position;
+		}
+		
+		while (position < length && history[position]) {
+			position++;
+		}
+		position++;
+	}
+	
+	return NULL;
+}
+
+/* Puts the line at the front of the history, dropping an older copy and the oldest entry. */
+static VOID AddToHistory(CHAR16 *name, CHAR16 *line, CHAR16 *history, UINTN size) {
+	UINTN length = StrLen(line) + 1, used, i;
+	CHAR16 *entry, *updated;
+	
+	updated = AllocatePool(length * sizeof(CHAR16) + size);
+	if (!updated) {
+		return;
+	}
+	
+	CopyMem(updated, line, length * sizeof(CHAR16));
+	used = length;
+	for (i = 0; i < LINE_HISTORY_ENTRIES - 1 && (entry = HistoryEntry(history, size, i)); i++) {
+		UINTN entry_length = StrLen(entry) + 1;
+		if (StrCmp(entry, line) != 0) {
+			CopyMem(updated + used, entry, entry_length * sizeof(CHAR16));
+			used += entry_length;
+		}
+	}
+	
+	VariableSet(&enterprise_variable_guid, name, (CHAR8 *)updated, used * sizeof(CHAR16), TRUE);
+	FreePool(updated);
+}
+
+/*
+ * Reads a line of at most max_length characters into buffer, which has to hold one more
+ * character for the terminator, and echoes it where the cursor is. Returns EFI_ABORTED if
+ * the user presses Escape. If history is not NULL, it names the variable the lines are
+ * remembered in.
+ */
+EFI_STATUS ReadLine(CHAR16 *buffer, UINTN max_length, CHAR16 *history) {
+	EFI_STATUS err;
+	LineEditor editor;
+	CHAR16 *entries = NULL, *draft = NULL;
+	UINTN entries_size = 0, columns, rows;
+	INTN recalled = -1; // The history entry shown, or -1 for the line being typed.
+	UINT64 key;
+	
+	editor.text = buffer;
+	editor.max_length = max_length;
+	editor.length = editor.cursor = editor.offset = 0;
+	editor.text[0] = '\0';
+	
+	// The line goes from the cursor to the end of the row.
+	editor.column = ST->ConOut->Mode->CursorColumn;
+	editor.row = ST->ConOut->Mode->CursorRow;
+	if (EFI_ERROR(uefi_call_wrapper(ST->ConOut->QueryMode, 4, ST->ConOut, ST->ConOut->Mode->Mode, &columns, &rows))) {
+		columns = 80;
+	}
+	editor.width = columns > editor.column + 1 ? columns - editor.column - 1 : 1;
+	if (editor.width > LINE_MAX_WIDTH) {
+		editor.width = LINE_MAX_WIDTH;
+	}
+	
+	// Ignore a history that doesn't end in a terminator, rather than read past it.
+	if (history && (EFI_ERROR(VariableGet(&enterprise_variable_guid, history, (CHAR8 **)&entries, &entries_size)) ||
+			entries_size < sizeof(CHAR16) || entries_size % sizeof(CHAR16) != 0 ||
+			entries[entries_size / sizeof(CHAR16) - 1] != '\0')) {
+		entries = NULL;
+		entries_size = 0;
+	}
+	
+	for (;;) {
+		err = key_read(&key, TRUE);
+		if (EFI_ERROR(err)) {
+			break;
+		}
+		
+		UINT16 scan = (key >> 16) & 0xffff;
+		CHAR16 c = key & 0xffff;
+		
+		if (c == CHAR_CARRIAGE_RETURN) {
+			break;
+		} else if (scan == SCAN_ESC) {
+			err = EFI_ABORTED;
+			break;
+		} else if (c >= 0x20 && c <= 0x7e) {
+			if (editor.length == editor.max_length) {
+				continue;
+			}
+			
+			if (editor.cursor == editor.length) {
+				editor.text[editor.length++] = c;
+				editor.text[editor.length] = '\0';
+				editor.cursor++;
+				
+				// Typing at the end of the line only needs the new character echoed.
+				if (editor.cursor - editor.offset < editor.width) {
+					CHAR16 echo[2] = { c, '\0' };
+					uefi_call_wrapper(ST->ConOut->OutputString, 2, ST->ConOut, echo);
+					continue;
+				}
+			} else {
+				CopyMem(editor.text + editor.cursor + 1, editor.text + editor.cursor,
+					(editor.length - editor.cursor + 1) * sizeof(CHAR16));
+				editor.text[editor.cursor++] = c;
+				editor.length++;
+			}
+		} else if (c == CHAR_BACKSPACE || scan == SCAN_DELETE) {
+			if (c == CHAR_BACKSPACE) {
+				if (editor.cursor == 0) {
+					continue;
+				}
+				editor.cursor--;
+			} else if (editor.cursor == editor.length) {
+				continue;
+			}
+			
+			CopyMem(editor.text + editor.cursor, editor.text + editor.cursor + 1,
+				(editor.length - editor.cursor) * sizeof(CHAR16));
+			editor.length--;
+		} else if (scan == SCAN_LEFT && editor.cursor > 0) {
+			editor.cursor--;
+		} else if (scan == SCAN_RIGHT && editor.cursor < editor.length) {
+			editor.cursor++;
+		} else if (scan == SCAN_HOME) {
+			editor.cursor = 0;
+		} else if (scan == SCAN_END) {
+			editor.cursor = editor.length;
+		} else if (scan == SCAN_UP && HistoryEntry(entries, entries_size, recalled + 1)) {
+			// Keep what was being typed, so that going back down brings it back.
+			if (recalled == -1 && !draft) {
+				draft = StrDuplicate(editor.text);
+			}
+			recalled++;
+			SetLine(&editor, HistoryEntry(entries, entries_size, recalled));
+		} else if (scan == SCAN_DOWN && recalled >= 0) {
+			recalled--;
+			SetLine(&editor, recalled >= 0 ? HistoryEntry(entries, entries_size, recalled) : (draft ? draft : L""));
+		} else {
+			continue;
+		}
+		
+		RedrawLine(&editor);
+	}
+	
+	if (draft) {
+		FreePool(draft);
+	}
+	if (!EFI_ERROR(err) && history && editor.length > 0) {
+		AddToHistory(history, editor.text, entries, entries_size);
+	}
+	
+	Print(L"\n");
+	return err;
+}
@@ -0,0 +1,34 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _lineedit_h
+#define _lineedit_h
+#include "main.h"
+
+/*
+ * A single line text editor for the console. The line can be edited anywhere with the
+ * arrow, Home, End, Backspace and Delete keys, and lines entered earlier can be brought
+ * back with the up and down arrows. The history is kept in a non-volatile variable.
+ */
+#define LINE_HISTORY_ENTRIES 8
+
+EFI_STATUS ReadLine(CHAR16 *, UINTN, CHAR16 *);
+
+#endif
@@ -0,0 +1,362 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "linux.h"
+#include "validation.h"
+#include "variables.h"
+#include "volumes.h"
+
+/* Offsets into the boot sector and setup header, see Documentation/x86/boot.txt. */
+#define SETUP_SECTS 0x1f1
+#define SETUP_HEADER 0x1f1
+#define SETUP_JUMP 0x201
+#define SETUP_MAGIC 0x202
+#define SETUP_VERSION 0x206
+#define SETUP_TYPE_OF_LOADER 0x210
+#define SETUP_CODE32_START 0x214
+#define SETUP_RAMDISK_IMAGE 0x218
+#define SETUP_RAMDISK_SIZE 0x21c
+#define SETUP_CMD_LINE_PTR 0x228
+#define SETUP_INITRD_ADDR_MAX 0x22c
+#define SETUP_KERNEL_ALIGNMENT 0x230
+#define SETUP_RELOCATABLE_KERNEL 0x234
+#define SETUP_XLOADFLAGS 0x236
+#define SETUP_CMDLINE_SIZE 0x238
+#define SETUP_PREF_ADDRESS 0x258
+#define SETUP_INIT_SIZE 0x260
+#define SETUP_HANDOVER_OFFSET 0x264
+
+#define SETUP_MAGIC_VALUE 0x53726448 // "HdrS"
+#define SETUP_READ_SIZE 1024 // Covers the longest setup header there can be.
+
+#define XLF_EFI_HANDOVER_32 (1 << 2)
+#define XLF_EFI_HANDOVER_64 (1 << 3)
+
+#define FIELD(buffer, offset, type) (*(type *)((UINT8 *)(UINTN)(buffer) + (offset)))
+
+#ifdef __x86_64__
+	#define XLF_EFI_HANDOVER XLF_EFI_HANDOVER_64
+	#define HANDOVER_ENTRY_OFFSET 512 // The 64-bit entry comes after the 32-bit one.
+	typedef VOID (*HandoverEntry)(EFI_HANDLE, EFI_SYSTEM_TABLE *, VOID *);
+#elif defined(__i386__)
+	#define XLF_EFI_HANDOVER XLF_EFI_HANDOVER_32
+	#define HANDOVER_ENTRY_OFFSET 0
+	typedef VOID (*HandoverEntry)(EFI_HANDLE, EFI_SYSTEM_TABLE *, VOID *) __attribute__((regparm(0)));
+#endif
+
+/* Reads part of a file into memory that has already been set aside. */
+static EFI_STATUS ReadAt(EFI_FILE_HANDLE file, UINT64 offset, VOID *buffer, UINTN size) {
+	EFI_STATUS err = uefi_call_wrapper(file->SetPosition, 2, file, offset);
+	UINT8 *dest = buffer;
+	
+	// Some firmware can't read very large amounts at once.
+	while (!EFI_ERROR(err) && size > 0) {
+		UINTN read_size = size < FILE_STREAM_DEFAULT_CHUNK_SIZE ? size : FILE_STREAM_DEFAULT_CHUNK_SIZE;
+		
+		err = uefi_call_wrapper(file->Read, 3, file, &read_size, dest);
+		if (!EFI_ERROR(err) && read_size == 0) {
+			err = EFI_END_OF_FILE;
+		}
+		
+		dest += read_size;
+		size -= read_size;
+	}
+	
+	return err;
+}
+
+/*
+ * Sets aside memory for the kernel, at its preferred address if that's free. Otherwise
+ * a relocatable kernel goes anywhere below 4 GB with the alignment it asks for; the
+ * pages around the aligned part are given back.
+ */
+static EFI_STATUS AllocateKernel(VOID *setup, UINTN pages, LinuxImage *image) {
+	UINT64 preferred = FIELD(setup, SETUP_PREF_ADDRESS, UINT64);
+	UINT32 alignment = FIELD(setup, SETUP_KERNEL_ALIGNMENT, UINT32);
+	EFI_PHYSICAL_ADDRESS address = preferred;
+	UINTN extra_pages, head_pages;
+	EFI_STATUS err;
+	
+	image->kernel_pages = pages;
+	if (preferred && !EFI_ERROR(uefi_call_wrapper(BS->AllocatePages, 4, AllocateAddress, EfiLoaderData, pages, &address))) {
+		image->kernel = address;
+		image->preferred_address = TRUE;
+		return EFI_SUCCESS;
+	}
+	
+	if (!FIELD(setup, SETUP_RELOCATABLE_KERNEL, UINT8)) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	if (alignment < EFI_PAGE_SIZE || (alignment & (alignment - 1))) {
+		alignment = EFI_PAGE_SIZE;
+	}
+	extra_pages = EFI_SIZE_TO_PAGES(alignment) - 1;
+	address = 0xffffffff;
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData, pages + extra_pages, &address);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	image->kernel = (address + alignment - 1) & ~((EFI_PHYSICAL_ADDRESS)alignment - 1);
+	head_pages = (image->kernel - address) / EFI_PAGE_SIZE;
+	if (head_pages > 0) {
+		uefi_call_wrapper(BS->FreePages, 2, address, head_pages);
+	}
+	if (extra_pages > head_pages) {
+		uefi_call_wrapper(BS->FreePages, 2, image->kernel + pages * EFI_PAGE_SIZE, extra_pages - head_pages);
+	}
+	
+	return EFI_SUCCESS;
+}
+
+/*
+ * Loads the kernel and initrd at the given paths and prepares the boot parameters. The
+ * kernel has to support the EFI handover protocol for this architecture.
+ */
+EFI_STATUS LinuxLoad(EFI_FILE_HANDLE root, CHAR16 *kernel_path, CHAR16 *initrd_path, CHAR8 *cmdline, OUT LinuxImage *image) {
+#if defined(__x86_64__) || defined(__i386__)
+	EFI_FILE_HANDLE kernel = NULL;
+	EFI_FILE_INFO kernel_info, initrd_info;
+	FileStream *initrd = NULL;
+	UINT8 setup[SETUP_READ_SIZE];
+	UINT64 payload_offset, payload_size, memory_size;
+	UINT32 initrd_max;
+	UINTN cmdline_length = strlena(cmdline);
+	EFI_STATUS err;
+	
+	ZeroMem(image, sizeof(LinuxImage));
+	if (EFI_ERROR(FileCacheGetInfo(root, kernel_path, &kernel_info)) ||
+		EFI_ERROR(FileCacheGetInfo(root, initrd_path, &initrd_info)) || kernel_info.FileSize <= SETUP_READ_SIZE) {
+		return EFI_NOT_FOUND;
+	}
+	image->initrd_size = initrd_info.FileSize;
+	
+	err = FileCacheOpen(root, kernel_path, &kernel);
+	if (!EFI_ERROR(err)) {
+		err = ReadAt(kernel, 0, setup, SETUP_READ_SIZE);
+	}
+	if (EFI_ERROR(err)) {
+		goto fail;
+	}
+	
+	// The handover protocol came with version 2.11 of the boot protocol.
+	if (FIELD(setup, SETUP_MAGIC, UINT32) != SETUP_MAGIC_VALUE || FIELD(setup, SETUP_VERSION, UINT16) < 0x20b ||
+		!(FIELD(setup, SETUP_XLOADFLAGS, UINT16) & XLF_EFI_HANDOVER) || !FIELD(setup, SETUP_HANDOVER_OFFSET, UINT32)) {
+		err = EFI_UNSUPPORTED;
+		goto fail;
+	}
+	image->handover_offset = FIELD(setup, SETUP_HANDOVER_OFFSET, UINT32);
+	
+	// The protected mode code follows the real mode setup code. It needs init_size bytes
+	// from where it is loaded to decompress itself in place.
+	payload_offset = ((setup[SETUP_SECTS] ? setup[SETUP_SECTS] : 4) + 1) * 512;
+	if (payload_offset >= kernel_info.FileSize) {
+		err = EFI_LOAD_ERROR;
+		goto fail;
+	}
+	payload_size = kernel_info.FileSize - payload_offset;
+	memory_size = FIELD(setup, SETUP_INIT_SIZE, UINT32);
+	if (memory_size < payload_size) {
+		memory_size = payload_size;
+	}
+	
+	err = AllocateKernel(setup, EFI_SIZE_TO_PAGES(memory_size), image);
+	if (EFI_ERROR(err)) {
+		goto fail;
+	}
+	
+	// The boot parameters start out as a copy of the setup header.
+	image->parameters = 0x3fffffff;
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData, 1, &image->parameters);
+	if (EFI_ERROR(err)) {
+		image->parameters = 0;
+		goto fail;
+	}
+	ZeroMem((VOID *)(UINTN)image->parameters, EFI_PAGE_SIZE);
+	CopyMem((UINT8 *)(UINTN)image->parameters + SETUP_HEADER, setup + SETUP_HEADER,
+		SETUP_MAGIC + setup[SETUP_JUMP] - SETUP_HEADER);
+	FIELD(image->parameters, SETUP_TYPE_OF_LOADER, UINT8) = 0xff;
+	FIELD(image->parameters, SETUP_CODE32_START, UINT32) = (UINT32)image->kernel;
+	
+	if (cmdline_length > FIELD(setup, SETUP_CMDLINE_SIZE, UINT32)) {
+		cmdline_length = FIELD(setup, SETUP_CMDLINE_SIZE, UINT32);
+	}
+	image->cmdline = 0xa0000;
+	image->cmdline_pages = EFI_SIZE_TO_PAGES(cmdline_length + 1);
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData, image->cmdline_pages, &image->cmdline);
+	if (EFI_ERROR(err)) {
+		image->cmdline = 0;
+		goto fail;
+	}
+	CopyMem((VOID *)(UINTN)image->cmdline, cmdline, cmdline_length);
+	((CHAR8 *)(UINTN)image->cmdline)[cmdline_length] = '\0';
+	FIELD(image->parameters, SETUP_CMD_LINE_PTR, UINT32) = (UINT32)image->cmdline;
+	
+	// Put the initrd as high as the kernel can reach, out of the way of everything the
+	// kernel sets up as it boots.
+	initrd_max = FIELD(setup, SETUP_INITRD_ADDR_MAX, UINT32);
+	image->initrd = initrd_max ? initrd_max : 0x37ffffff;
+	image->initrd_pages = EFI_SIZE_TO_PAGES(image->initrd_size);
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData, image->initrd_pages, &image->initrd);
+	if (EFI_ERROR(err)) {
+		image->initrd = 0;
+		goto fail;
+	}
+	
+	// Everything has its place now. The initrd, usually the bigger file, is started on
+	// first, so that its first chunk arrives while the kernel is read on firmware with
+	// asynchronous reads; the rest of it is read straight into place.
+	err = FileStreamOpen(root, initrd_path, NULL, 0, &initrd);
+	if (!EFI_ERROR(err)) {
+		err = FileStreamStart(initrd);
+	}
+	if (!EFI_ERROR(err)) {
+		err = ReadAt(kernel, payload_offset, (VOID *)(UINTN)image->kernel, payload_size);
+	}
+	if (!EFI_ERROR(err)) {
+		err = FileStreamReadInto(initrd, (VOID *)(UINTN)image->initrd, image->initrd_size);
+	}
+	if (EFI_ERROR(err)) {
+		goto fail;
+	}
+	FIELD(image->parameters, SETUP_RAMDISK_IMAGE, UINT32) = (UINT32)image->initrd;
+	FIELD(image->parameters, SETUP_RAMDISK_SIZE, UINT32) = (UINT32)image->initrd_size;
+	
+	uefi_call_wrapper(kernel->Close, 1, kernel);
+	FileStreamClose(initrd);
+	return EFI_SUCCESS;
+	
+fail:
+	if (kernel) uefi_call_wrapper(kernel->Close, 1, kernel);
+	FileStreamClose(initrd);
+	LinuxFree(image);
+	return err;
+#else
+	(void)root;
+	(void)kernel_path;
+	(void)initrd_path;
+	(void)cmdline;
+	(void)image;
+	return EFI_UNSUPPORTED;
+#endif
+}
+
+/* Jumps to the kernel's handover entry point. Only returns if the kernel can't be started. */
+EFI_STATUS LinuxStart(LinuxImage *image) {
+#if defined(__x86_64__) || defined(__i386__)
+	HandoverEntry entry = (HandoverEntry)(UINTN)(image->kernel + image->handover_offset + HANDOVER_ENTRY_OFFSET);
+	
+	__asm__ volatile ("cli");
+	entry(global_image, ST, (VOID *)(UINTN)image->parameters);
+#else
+	(void)image;
+#endif
+	return EFI_LOAD_ERROR;
+}
+
+/* Gives back the memory of a kernel that isn't going to be started. */
+VOID LinuxFree(LinuxImage *image) {
+	if (image->kernel) {
+		uefi_call_wrapper(BS->FreePages, 2, image->kernel, image->kernel_pages);
+	}
+	if (image->initrd) {
+		uefi_call_wrapper(BS->FreePages, 2, image->initrd, image->initrd_pages);
+	}
+	if (image->cmdline) {
+		uefi_call_wrapper(BS->FreePages, 2, image->cmdline, image->cmdline_pages);
+	}
+	if (image->parameters) {
+		uefi_call_wrapper(BS->FreePages, 2, image->parameters, 1);
+	}
+	ZeroMem(image, sizeof(LinuxImage));
+}
+
+/*
+ * Boots an entry whose kernel is a unified kernel image, a PE file that carries the
+ * kernel, initrd and command line in sections of its own. The file is read in one go
+ * and started from memory. Only returns if that fails.
+ */
+EFI_STATUS BootUnifiedKernelImage(LinuxBootOption *option, CHAR16 *options) {
+	EFI_DEVICE_PATH *path = NULL;
+	EFI_LOADED_IMAGE *loaded_image;
+	EFI_HANDLE image;
+	CHAR8 *contents = NULL;
+	CHAR16 *file_path;
+	CHAR16 *problem = L"Error starting the kernel of this entry";
+	UINTN size;
+	EFI_STATUS err = EFI_LOAD_ERROR;
+	
+	if (!option->volume || !option->kernel_path) {
+		DisplayErrorText(problem);
+		Print(L": %r\n", EFI_NOT_FOUND);
+		return EFI_NOT_FOUND;
+	}
+	
+	// Options made up of nothing but spaces would still replace the image's command line.
+	while (options && *options == ' ') {
+		options++;
+	}
+	
+	file_path = GRUBPathToEFIPath(option->kernel_path);
+	size = FileRead(option->volume->root, file_path, &contents);
+	if (size < 2 || contents[0] != 'M' || contents[1] != 'Z') {
+		problem = L"Error: the kernel of this entry isn't a valid EFI image";
+		goto out;
+	}
+	
+	path = FileDevicePath(option->volume->device, file_path);
+	err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, global_image, path, contents, size, &image);
+	if (EFI_ERROR(err)) {
+		goto out;
+	}
+	
+	// The image's own command line is used unless we have something to add.
+	if (options && *options) {
+		err = uefi_call_wrapper(BS->HandleProtocol, 3, image, &LoadedImageProtocol, (VOID **)&loaded_image);
+		if (EFI_ERROR(err)) {
+			uefi_call_wrapper(BS->UnloadImage, 1, image);
+			goto out;
+		}
+		loaded_image->LoadOptions = options;
+		loaded_image->LoadOptionsSize = StrSize(options);
+	}
+	
+	StopBackgroundValidation();
+	FileCacheFlush();
+	VariableFlush();
+	if (!headless) {
+		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
+	}
+	err = uefi_call_wrapper(BS->StartImage, 3, image, NULL, NULL);
+	
+out:
+	if (EFI_ERROR(err)) {
+		DisplayErrorText(problem);
+		Print(L": %r\n", err);
+	}
+	if (path) FreePool(path);
+	if (contents) FreePool(contents);
+	FreePool(file_path);
+	return err;
+}
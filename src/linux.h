@@ -0,0 +1,43 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _linux_h
+#define _linux_h
+#include "main.h"
+
+/*
+ * Loads a bzImage kernel and its initrd straight to where the kernel wants them, going
+ * by the kernel's setup header, and starts it through the EFI handover protocol. The
+ * kernel then has no reason to move itself or its initrd before decompressing.
+ */
+typedef struct LinuxImage {
+	EFI_PHYSICAL_ADDRESS kernel, initrd, parameters, cmdline;
+	UINTN kernel_pages, initrd_pages, cmdline_pages;
+	UINT64 initrd_size;
+	UINT32 handover_offset;
+	BOOLEAN preferred_address; // Whether the kernel was put where it asked to be.
+} LinuxImage;
+
+EFI_STATUS LinuxLoad(EFI_FILE_HANDLE, CHAR16 *, CHAR16 *, CHAR8 *, OUT LinuxImage *);
+EFI_STATUS LinuxStart(LinuxImage *);
+VOID LinuxFree(LinuxImage *);
+EFI_STATUS BootUnifiedKernelImage(LinuxBootOption *, CHAR16 *);
+
+#endif
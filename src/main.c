@@ -24,24 +24,45 @@
 #include "menu.h"
 #include "utils.h"
 #include "distribution.h"
+#include "validation.h"
+#include "volumes.h"
+#include "catalog.h"
+#include "kernelcache.h"
+#include "handoff.h"
+#include "variables.h"
+#include "screen.h"
+#include "autoboot.h"
+#include "hardware.h"
+#include "memory.h"
+#include "eltorito.h"
+#include "linux.h"
 
 const EFI_GUID enterprise_variable_guid = {0xd92996a6, 0x9f56, 0x48fc, {0xc4, 0x45, 0xb9, 0x0f, 0x23, 0x98, 0x6d, 0x4a}};
 const EFI_GUID grub_variable_guid = {0x8BE4DF61, 0x93CA, 0x11d2, {0xAA, 0x0D, 0x00, 0xE0, 0x98, 0x03, 0x2B,0x8C}};
 
-static void ReadConfigurationFile(const CHAR16 const *);
+static void ReadConfigurationFile(CHAR8 *, Volume *);
+static VOID DropUnbootableEntries(BootableLinuxDistro *);
+static VOID AddISOEntries(Volume *);
 
 static EFI_STATUS console_text_mode(VOID);
 static EFI_STATUS SetupDisplay(VOID);
+static VOID SetupConsole(BOOLEAN);
 UINTN numberOfDisplayRows, numberOfDisplayColoumns, highestModeNumberAvailable = 0;
 CHAR16 *banner = L"Welcome to Enterprise! - Version %d.%d.%d\n";
 
 EFI_LOADED_IMAGE *this_image = NULL;
 static EFI_FILE *root_dir;
 static BOOLEAN shouldAutoboot;
-static UINTN autobootIndex = 0;
+
+// Set when the console is a serial port. Output is kept to a minimum in that case.
+BOOLEAN headless = FALSE;
+
+// Set to report how the kernel is loaded, right before it is started.
+BOOLEAN trace = FALSE;
 
 EFI_HANDLE global_image = NULL; // EFI_HANDLE is a typedef to a VOID pointer.
 BootableLinuxDistro *distributionListRoot;
+static BootableLinuxDistro *distributionListTail;
 static INTN distroCount = -1; // start at -1 due to an error on my part.
 
 /* entry function for EFI */
@@ -53,7 +74,11 @@ EFI_STATUS efi_main(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE *systab) {
 	console_text_mode(); // Put the console into text mode. If we don't do that, the image of the Apple
 	                     // boot manager will remain on the screen and the user won't see any output
 	                     // from the program.
-	SetupDisplay();
+	
+	// There are no display modes to pick from on a serial console. Nor does the display
+	// matter if the running system has already picked the entry for this boot.
+	headless = ScreenIsSerialOnly();
+	BOOLEAN next_boot = NextBootRequested();
 	global_image = image_handle;
 	
 	err = uefi_call_wrapper(BS->HandleProtocol, 3, image_handle, &LoadedImageProtocol, (void *)&this_image);
@@ -74,66 +99,132 @@ EFI_STATUS efi_main(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE *systab) {
 	// Set all present options to be false (i.e off).
 	SetMem(preset_options_array, PRESET_OPTIONS_SIZE * sizeof(BOOLEAN), 0);
 	
-	/* Print the welcome message. */
 	uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK); // Set the text color.
-	uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut); // Clear the screen.
-	Print(banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH); // Print the welcome information.
 	uefi_call_wrapper(ST->ConIn->Reset, 2, ST->ConIn, FALSE);
 	uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, FALSE); // Disable display of the cursor.
 	
 	BOOLEAN can_continue = TRUE;
 	
-	/* Check to make sure that we have our configuration file and GRUB bootloader. */
-	if (!FileExists(root_dir, L"\\efi\\boot\\enterprise.cfg")) {
+	/* This will always stay consistent, otherwise we'll lose the list in memory.*/
+	distributionListRoot = distributionListTail = AllocateZeroPool(sizeof(BootableLinuxDistro));
+	if (!distributionListRoot) {
+		DisplayErrorText(L"Unable to allocate memory for linked list.\n");
+	}
+	
+	/* Look for configuration files and ISO files on every volume. */
+	Volume *volumes;
+	UINTN volume_count = LocateVolumes(this_image->DeviceHandle, &volumes);
+	if (volume_count == 0 || !volumes[0].is_boot_volume) {
+		DisplayErrorText(L"Warning: couldn't enumerate volumes, only using the boot volume.\n");
+		FreeVolumes(volumes, volume_count);
+		volumes = AllocateZeroPool(sizeof(Volume));
+		volume_count = volumes ? 1 : 0;
+	} else {
+		uefi_call_wrapper(volumes[0].root->Close, 1, volumes[0].root);
+	}
+	
+	if (volume_count > 0) {
+		volumes[0].device = this_image->DeviceHandle;
+		volumes[0].root = root_dir;
+		volumes[0].is_boot_volume = TRUE;
+	}
+	
+	// Start reading from every volume before waiting on any of them. The directory
+	// listings are done while the reads are in flight.
+	UINTN i;
+	StartGRUBPreload(root_dir, this_image->DeviceHandle);
+	for (i = 0; i < volume_count; i++) {
+		StartConfigurationRead(&volumes[i], L"\\efi\\boot\\enterprise.cfg");
+	}
+	for (i = 0; i < volume_count; i++) {
+		volumes[i].iso_file_count = ListISOFiles(&volumes[i], &volumes[i].iso_files);
+	}
+	
+	BOOLEAN found_configuration = FALSE, console_ready = FALSE;
+	for (i = 0; i < volume_count && distributionListRoot; i++) {
+		CHAR8 *contents = FinishConfigurationRead(&volumes[i]);
+		
 		// Check if we have an old-style configuration file instead.
-		if (!FileExists(root_dir, L"\\efi\\boot\\.MLUL-Live-USB")) {
-			DisplayErrorText(L"Error: can't find configuration file.\n");
-			can_continue = FALSE;
-		} else {
+		if (!contents && volumes[i].is_boot_volume && FileExists(root_dir, L"\\efi\\boot\\.MLUL-Live-USB")) {
 			DisplayErrorText(L"Warning: old-style configuration file found, please upgrade to the new format\n");
-			ReadConfigurationFile(L"\\efi\\boot\\.MLUL-Live-USB");
+			if (FileRead(root_dir, L"\\efi\\boot\\.MLUL-Live-USB", &contents) == 0) {
+				DisplayErrorText(L"Error: Couldn't read configuration information.\n");
+				contents = NULL;
+			}
+		}
+		
+		if (contents) {
+			found_configuration = TRUE;
+			ReadConfigurationFile(contents, &volumes[i]);
+			FreePool(contents);
+		}
+		
+		// The boot volume comes first, and its configuration can say that the console is
+		// a serial port; the display is only set up once that is known.
+		if (!console_ready) {
+			SetupConsole(next_boot);
+			console_ready = TRUE;
+		}
+		
+		if (distributionListRoot) {
+			AddISOEntries(&volumes[i]);
 		}
-	} else {
-		ReadConfigurationFile(L"\\efi\\boot\\enterprise.cfg");
 	}
 	
-	// Verify if the configuration file is valid.
-	if (!distributionListRoot) {
-		DisplayErrorText(L"Error: configuration file parsing error.\n");
+	if (!console_ready) {
+		SetupConsole(next_boot);
+	}
+	
+	// GRUB has been read in the meantime; a missing or broken one is reported now rather
+	// than once the user has picked an entry.
+	FinishGRUBPreload();
+	if (!core_files.grub_image) {
+		DisplayErrorText(L"Error: can't find GRUB bootloader, or it isn't a valid EFI image.\n");
+	}
+	
+	if (!found_configuration && distributionListRoot && !distributionListRoot->next) {
+		DisplayErrorText(L"Error: can't find configuration file.\n");
 		can_continue = FALSE;
 	}
 	
-	// Check for GRUB.
-	if (!FileExists(root_dir, L"\\efi\\boot\\boot.efi")) {
-		DisplayErrorText(L"Error: can't find GRUB bootloader!.\n");
+	// Verify if the configuration file is valid.
+	if (!distributionListRoot) {
+		DisplayErrorText(L"Error: configuration file parsing error.\n");
 		can_continue = FALSE;
 	}
 	
-	// Check if there is a persistence file present.
-	// TODO: Support distributions other than Ubuntu.
-	if (FileExists(root_dir, L"\\casper-rw") && can_continue) {
-		DisplayColoredText(L"Found a persistence file! You can enable persistence by " \
-							"selecting it in the Modify Boot Settings screen.\n");
-		
-		preset_options_array[4] = true;
+	// The files the entries refer to, GRUB and the persistence file are looked for in
+	// the background while the menu is shown.
+	if (can_continue) {
+		StartBackgroundValidation(root_dir);
 	}
 	
 	// Display the menu where the user can select what they want to do.
 	if (can_continue) {
-		if (!shouldAutoboot) {
-			DisplayMenu();
-		} else {
-			// Don't allow the user to overflow.
-			if (autobootIndex > (UINTN)distroCount) {
-				DisplayErrorText(L"Cannot continue because you have selected an invalid distribution.\nRestarting...\n");
-				uefi_call_wrapper(BS->Stall, 1, 1000 * 1000);
-				return EFI_LOAD_ERROR;
+		// Look for an entry meant for this machine. Its options are used wherever it is
+		// booted from.
+		INTN hardware_index = MatchHardwareProfile();
+		
+		// An entry picked for this boot only goes before everything else.
+		if (next_boot) {
+			INTN next_index = TakeNextBootEntry();
+			if (next_index >= 0) {
+				BootLinuxWithOptions(next_index == hardware_index ? HardwareKernelOptions() : L"", next_index);
+			} else {
+				DisplayErrorText(L"The entry picked for this boot can't be found.\n");
 			}
-
-			Print(L"Autobooting %d.\n", autobootIndex);
-			uefi_call_wrapper(BS->Stall, 1, 1000 * 1000);
-			BootLinuxWithOptions(L"", autobootIndex);
 		}
+		
+		INTN autoboot_index = AutobootEntryIndex(shouldAutoboot, hardware_index);
+		if (shouldAutoboot && autoboot_index < 0) {
+			DisplayErrorText(L"The entry to autoboot can't be found.\n");
+		}
+		
+		// Fall back to the menu if the boot fails, or the user interrupts it.
+		if (autoboot_index >= 0 && AutobootCountdown(autoboot_index)) {
+			BootLinuxWithOptions(autoboot_index == hardware_index ? HardwareKernelOptions() : L"", autoboot_index);
+		}
+		DisplayMenu();
 	} else {
 		DisplayErrorText(L"Cannot continue because core files are missing or damaged.\nRestarting...\n");
 		uefi_call_wrapper(BS->Stall, 1, 1000 * 1000);
@@ -143,10 +234,85 @@ EFI_STATUS efi_main(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE *systab) {
 	return EFI_SUCCESS;
 }
 
+/*
+ * The console mode chosen on an earlier boot. It is only used again if the firmware and
+ * the graphics device it was chosen on are the same ones, going by key.
+ */
+typedef struct SavedConsoleMode {
+	UINT64 key;
+	UINT32 mode;
+	UINT32 mode_count; // As reported by the firmware.
+	UINT64 columns;
+	UINT64 rows;
+} SavedConsoleMode;
+
+/* Identifies the firmware and graphics device the console modes belong to. */
+static UINT64 ConsoleModeKey(VOID) {
+	UINT64 key = HASH_INITIAL_VALUE;
+	EFI_HANDLE *handles = NULL;
+	UINTN count = 0, i;
+	
+	if (ST->FirmwareVendor) {
+		key = HashBytes(ST->FirmwareVendor, StrSize(ST->FirmwareVendor), key);
+	}
+	key = HashBytes(&ST->FirmwareRevision, sizeof(ST->FirmwareRevision), key);
+	
+	if (!EFI_ERROR(LibLocateHandle(ByProtocol, &GraphicsOutputProtocol, NULL, &count, &handles))) {
+		for (i = 0; i < count; i++) {
+			EFI_DEVICE_PATH *path = DevicePathFromHandle(handles[i]);
+			if (path) {
+				key = HashBytes(path, DevicePathSize(path), key);
+				break;
+			}
+		}
+		FreePool(handles);
+	}
+	
+	return key;
+}
+
+/* Remembers the console mode for the next boot. The write happens before handoff. */
+VOID SaveConsoleMode(UINTN mode) {
+	SavedConsoleMode saved;
+	
+	saved.key = ConsoleModeKey();
+	saved.mode = (UINT32)mode;
+	saved.mode_count = (UINT32)ST->ConOut->Mode->MaxMode;
+	saved.columns = numberOfDisplayRows;
+	saved.rows = numberOfDisplayColoumns;
+	VariableSet(&enterprise_variable_guid, L"Enterprise_ConsoleMode", (CHAR8 *)&saved, sizeof(saved), TRUE);
+}
+
+/* Switches to the console mode chosen on an earlier boot, if it is still valid. */
+static BOOLEAN RestoreConsoleMode(VOID) {
+	SavedConsoleMode *saved;
+	UINTN size;
+	
+	if (EFI_ERROR(VariableGet(&enterprise_variable_guid, L"Enterprise_ConsoleMode", (CHAR8 **)&saved, &size)) ||
+		size != sizeof(SavedConsoleMode) || saved->key != ConsoleModeKey() ||
+		saved->mode_count != (UINT32)ST->ConOut->Mode->MaxMode || saved->mode >= saved->mode_count) {
+		return FALSE;
+	}
+	
+	if (EFI_ERROR(uefi_call_wrapper(ST->ConOut->SetMode, 2, ST->ConOut, saved->mode))) {
+		return FALSE;
+	}
+	
+	highestModeNumberAvailable = saved->mode + 1;
+	numberOfDisplayRows = saved->columns;
+	numberOfDisplayColoumns = saved->rows;
+	return TRUE;
+}
+
 static EFI_STATUS SetupDisplay(VOID) {
 	// Set the display to use the highest available resolution.
 	EFI_STATUS err = EFI_SUCCESS;
 	
+	// Nothing needs to be probed if we already know which mode to use.
+	if (RestoreConsoleMode()) {
+		return EFI_SUCCESS;
+	}
+	
 	while (!EFI_ERROR(err)) {
 		err = uefi_call_wrapper(ST->ConOut->QueryMode, 4, ST->ConOut, highestModeNumberAvailable, &numberOfDisplayRows, &numberOfDisplayColoumns);
 		Print(L"Detected mode %d: %d x %d.\n", highestModeNumberAvailable, numberOfDisplayRows, numberOfDisplayColoumns);
@@ -160,28 +326,84 @@ static EFI_STATUS SetupDisplay(VOID) {
 		DisplayErrorText(L"Can't set display mode! ");
 		Print(L"%r\n", err);
 		uefi_call_wrapper(BS->Stall, 1, 500 * 1000);
+	} else {
+		SaveConsoleMode(highestModeNumberAvailable - 1);
 	}
 	
 	return err;
 }
 
+/* Sets up the display and prints the welcome message. On a serial console, the menu says who we are instead. */
+static VOID SetupConsole(BOOLEAN next_boot) {
+	if (headless || next_boot) {
+		return;
+	}
+	
+	SetupDisplay();
+	uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut); // Clear the screen.
+	Print(banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH); // Print the welcome information.
+}
+
 EFI_STATUS BootLinuxWithOptions(CHAR16 *params, UINT16 distribution) {
 	EFI_STATUS err;
 	EFI_HANDLE image;
 	EFI_DEVICE_PATH *path = NULL;
 	
-	uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
-	
-	// We need to move forward to the proper distribution struct.
-	BootableLinuxDistro *conductor = distributionListRoot->next;
+	if (!headless) {
+		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
+	}
 	
-	INTN i; for (i = 0; i < distribution && conductor != NULL; i++, conductor = conductor->next);
-	LinuxBootOption *boot_params = conductor->bootOption;
+	LinuxBootOption *boot_params = BootOptionAtIndex(distribution);
 	if (!boot_params) {
 		DisplayErrorText(L"Error: couldn't get Linux distribution boot settings.\n");
 		return EFI_LOAD_ERROR;
 	}
 	
+	// Entries that aren't booted through GRUB need nothing else from us.
+	if (boot_params->loader != LOADER_GRUB) {
+		if (ValidateEntry(boot_params) == ENTRY_ISO_MISSING) {
+			DisplayErrorText(L"Error: ISO file ");
+			Print(L"%a not found.\n", boot_params->iso_path);
+			uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+			return EFI_NOT_FOUND;
+		}
+		
+		RememberBootedEntry(boot_params);
+		if (boot_params->loader == LOADER_ELTORITO) {
+			err = BootElTorito(boot_params);
+		} else {
+			// Options from the kernel line come first, like they do with GRUB.
+			CHAR16 *options = PoolPrint(L"%a %s", boot_params->kernel_options ? boot_params->kernel_options : (CHAR8 *)"", params);
+			if (options) {
+				err = BootUnifiedKernelImage(boot_params, options);
+				FreePool(options);
+			} else {
+				DisplayErrorText(L"Error: couldn't allocate memory for the kernel options.\n");
+				err = EFI_OUT_OF_RESOURCES;
+			}
+		}
+		
+		// The loaders report their own errors.
+		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		return err;
+	}
+	
+	// Make sure that everything we need is actually there before going any further.
+	ValidateCoreFiles();
+	if (!core_files.grub_found) {
+		DisplayErrorText(L"Error: can't find GRUB bootloader!.\n");
+		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		return EFI_LOAD_ERROR;
+	}
+	
+	if (ValidateEntry(boot_params) == ENTRY_ISO_MISSING) {
+		DisplayErrorText(L"Error: ISO file ");
+		Print(L"%a not found.\n", boot_params->iso_path);
+		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		return EFI_NOT_FOUND;
+	}
+	RememberBootedEntry(boot_params);
+	
 	CHAR8 *kernel_path = boot_params->kernel_path;
 	CHAR8 *initrd_path = boot_params->initrd_path;
 	CHAR8 *boot_folder = boot_params->boot_folder;
@@ -194,41 +416,88 @@ EFI_STATUS BootLinuxWithOptions(CHAR16 *params, UINT16 distribution) {
 	// We also concatenate the kernel options given as part of the Enterprise configuration
 	// file with the user selected kernel options from the Advanced menu. The user selected
 	// options should override those given in the configuration file.
+	//
+	// If the configuration file doesn't give any kernel options, use the default command
+	// line from the boot catalog, if there is one.
 	CHAR8 *sized_str = UTF16toASCII(params, StrLen(params) + 1);
+	CHAR8 *config_options = boot_params->kernel_options;
+	if (!config_options || strlena(config_options) == 0) {
+		CatalogEntry *catalog_entry = LookupBootCatalog(boot_params);
+		config_options = catalog_entry && catalog_entry->cmdline ? catalog_entry->cmdline : (CHAR8 *)"";
+	}
+	
+	// Copy the distribution to RAM if there's plenty of memory to spare.
+	BOOLEAN toram = ShouldCopyToRAM(boot_params);
+	
 	CHAR8 *kernel_parameters = NULL;
-	kernel_parameters = AllocatePool(sizeof(CHAR8) * (strlena(sized_str) + strlena(boot_params->kernel_options)));
-	if (boot_params->kernel_options && strlena(boot_params->kernel_options) > 0) {
-		strcpya(kernel_parameters, boot_params->kernel_options);
-		strcata(kernel_parameters, sized_str);
-	} else {
-		strcpya(kernel_parameters, boot_params->kernel_options);
-	}
-	
-	efi_set_variable(&grub_variable_guid, L"Enterprise_LinuxBootOptions", kernel_parameters,
-		sizeof(kernel_parameters[0]) * (strlena(kernel_parameters) + 1), FALSE);
-	efi_set_variable(&grub_variable_guid, L"Enterprise_LinuxKernelPath", kernel_path,
-		sizeof(kernel_path[0]) * (strlena(kernel_path) + 1), FALSE);
-	efi_set_variable(&grub_variable_guid, L"Enterprise_InitRDPath", initrd_path,
-		sizeof(initrd_path[0]) * (strlena(initrd_path) + 1), FALSE);
-	efi_set_variable(&grub_variable_guid, L"Enterprise_ISOPath", iso_path,
-		sizeof(iso_path[0]) * (strlena(iso_path) + 1), FALSE);
-	efi_set_variable(&grub_variable_guid, L"Enterprise_BootFolder", boot_folder,
-		sizeof(boot_folder[0]) * (strlena(boot_folder) + 1), FALSE);
-	
-	// Load the EFI boot loader image into memory.
-	path = FileDevicePath(this_image->DeviceHandle, L"\\efi\\boot\\boot.efi");
-	err = uefi_call_wrapper(BS->LoadImage, 6, TRUE, global_image, path, NULL, 0, &image);
+	kernel_parameters = AllocatePool(sizeof(CHAR8) * (strlena(sized_str) + strlena(config_options) + 2 +
+		(toram ? sizeof(" toram") : 0)));
+	if (!kernel_parameters) {
+		DisplayErrorText(L"Error: couldn't allocate memory for the kernel parameters.\n");
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	strcpya(kernel_parameters, config_options);
+	if (strlena(config_options) > 0 && config_options[strlena(config_options) - 1] != ' ') {
+		strcata(kernel_parameters, (CHAR8 *)" ");
+	}
+	strcata(kernel_parameters, sized_str);
+	if (toram) {
+		strcata(kernel_parameters, (CHAR8 *)" toram");
+	}
+	
+	// If the kernel cache is enabled, start the kernel from there without GRUB. This only
+	// returns if that didn't work out, in which case we go through GRUB anyway.
+	if (KernelCacheEnabled() && !EFI_ERROR(BootFromKernelCache(boot_params, kernel_parameters))) {
+		return EFI_SUCCESS;
+	}
+	
+	// GRUB only looks for the ISO file on the volume we started from.
+	if (boot_params->volume && !boot_params->volume->is_boot_volume) {
+		DisplayErrorText(L"Error: GRUB can only boot ISO files on the boot volume.\n");
+		FreePool(kernel_parameters);
+		FreePool(sized_str);
+		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		return EFI_UNSUPPORTED;
+	}
+	
+	// Collect the parameters for GRUB. They are handed over once GRUB has been loaded.
+	Handoff handoff;
+	HandoffInitialize(&handoff);
+	HandoffAdd(&handoff, L"Enterprise_LinuxBootOptions", kernel_parameters);
+	HandoffAdd(&handoff, L"Enterprise_LinuxKernelPath", kernel_path);
+	HandoffAdd(&handoff, L"Enterprise_InitRDPath", initrd_path);
+	HandoffAdd(&handoff, L"Enterprise_ISOPath", iso_path);
+	HandoffAdd(&handoff, L"Enterprise_BootFolder", boot_folder);
+	
+	// We won't be looking at the disk again; release the handles we kept open.
+	StopBackgroundValidation();
+	FileCacheFlush();
+	
+	// Load the EFI boot loader from the copy read at startup. The device path still has to
+	// be given, since GRUB finds its files relative to where it was loaded from.
+	path = FileDevicePath(this_image->DeviceHandle, GRUB_IMAGE_PATH);
+	err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, global_image, path,
+		core_files.grub_image, core_files.grub_image_size, &image);
 	if (EFI_ERROR(err)) {
 		DisplayErrorText(L"Error loading image: ");
 		Print(L"%r\n", err);
 		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
 		FreePool(path);
+		if (handoff.data) {
+			FreePool(handoff.data);
+		}
 		
 		return EFI_LOAD_ERROR;
 	}
 	
+	HandoffFinish(&handoff, image);
+	VariableFlush();
+	
 	// Start the EFI boot loader.
-	uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut); // Clear the screen.
+	if (!headless) {
+		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut); // Clear the screen.
+	}
 	err = uefi_call_wrapper(BS->StartImage, 3, image, NULL, NULL);
 	if (EFI_ERROR(err)) {
 		DisplayErrorText(L"Error starting image: ");
@@ -245,39 +514,124 @@ EFI_STATUS BootLinuxWithOptions(CHAR16 *params, UINT16 distribution) {
 	return EFI_SUCCESS;
 }
 
-static void ReadConfigurationFile(const CHAR16 * const name) {
-	/* This will always stay consistent, otherwise we'll lose the list in memory.*/
-	distributionListRoot = AllocateZeroPool(sizeof(BootableLinuxDistro));
+/* Returns the boot settings of the given entry, counting from zero. */
+LinuxBootOption* BootOptionAtIndex(UINTN index) {
 	if (!distributionListRoot) {
-		DisplayErrorText(L"Unable to allocate memory for linked list.\n");
+		return NULL;
 	}
+	
+	// The first item in the list is blank.
+	BootableLinuxDistro *conductor = distributionListRoot->next;
+	UINTN i; for (i = 0; i < index && conductor != NULL; i++, conductor = conductor->next);
+	
+	return conductor ? conductor->bootOption : NULL;
+}
 
+/*
+ * Parses the contents of a configuration file found on the given volume and appends
+ * its entries to the list.
+ */
+static void ReadConfigurationFile(CHAR8 *contents, Volume *volume) {
 	BootableLinuxDistro *conductor; // Will point to each node as we traverse the list.
-	conductor = distributionListRoot; // Start by pointing at the first element.
+	conductor = distributionListTail; // Start by pointing at the last element.
 	
-	CHAR8 *contents;
-	UINTN read_bytes = FileRead(root_dir, name, &contents);
-	if (read_bytes == 0) {
-		DisplayErrorText(L"Error: Couldn't read configuration information.\n");
-		return;
-	}
+	// Remember where this file's entries start, in case we have to drop them.
+	BootableLinuxDistro *previousTail = distributionListTail;
+	INTN previousCount = distroCount;
 	
 	UINTN position = 0;
-	CHAR8 *key, *value, *distribution, *boot_folder;
+	CHAR8 *key, *value, *distribution = NULL, *boot_folder;
 	while ((GetConfigurationKeyAndValue(contents, &position, &key, &value))) {
 		/* 
 		 * We require the user to specify an entry, followed by the file name and
 		 * any information required to boot the Linux distribution.
 		 */
-		// The autoboot entry was enabled.
+		// The autoboot entry was enabled. Only the volume we were started from gets to
+		// decide this.
 		if (strcmpa((CHAR8 *)"autoboot", key) == 0) {
+			if (!volume->is_boot_volume) {
+				continue;
+			}
+			
+			// The entry is given by its number, by its name, or as "last".
 			shouldAutoboot = TRUE;
-
-			// Check if they've given us a parameter; if they have, check if it's a valid
-			// integer and then parse it.
-			// The user can currently only autoboot the first ten entries.
-			if (strlena(value) == 1 && (*value >= 48 && *value <= 57)) {
-				autobootIndex = *value - '0';
+			if (!SetAutobootEntry(value)) {
+				SetAutobootEntry((CHAR8 *)"0");
+			}
+		}
+		// How many seconds the user has to interrupt an autoboot.
+		else if (strcmpa((CHAR8 *)"timeout", key) == 0) {
+			UINTN seconds = 0;
+			
+			if (!volume->is_boot_volume) {
+				continue;
+			}
+			
+			for (; *value >= '0' && *value <= '9'; value++) {
+				seconds = seconds * 10 + (*value - '0');
+			}
+			SetAutobootTimeout(seconds);
+		}
+		// The user wants extracted kernels and initrds kept on the boot volume, using
+		// at most the given number of megabytes.
+		else if (strcmpa((CHAR8 *)"cache_size", key) == 0) {
+			UINT64 megabytes = 0;
+			
+			if (!volume->is_boot_volume) {
+				continue;
+			}
+			
+			for (; *value >= '0' && *value <= '9'; value++) {
+				megabytes = megabytes * 10 + (*value - '0');
+			}
+			InitializeKernelCache(root_dir, this_image->DeviceHandle, megabytes * 1024 * 1024);
+		}
+		// Whether toram is added when there is enough memory, and how many megabytes have
+		// to be left over for that.
+		else if (strcmpa((CHAR8 *)"auto_toram", key) == 0) {
+			if (volume->is_boot_volume) {
+				SetAutomaticToRAM(strcmpa((CHAR8 *)"off", value) != 0);
+			}
+		} else if (strcmpa((CHAR8 *)"toram_headroom", key) == 0) {
+			UINT64 megabytes = 0;
+			
+			if (!volume->is_boot_volume) {
+				continue;
+			}
+			
+			for (; *value >= '0' && *value <= '9'; value++) {
+				megabytes = megabytes * 10 + (*value - '0');
+			}
+			SetToRAMHeadroom(megabytes * 1024 * 1024);
+		}
+		// Whether the console is a serial port, if detecting that doesn't work out.
+		else if (strcmpa((CHAR8 *)"headless", key) == 0) {
+			if (volume->is_boot_volume) {
+				headless = strcmpa((CHAR8 *)"off", value) != 0;
+			}
+		}
+		// Whether to report how the kernel is loaded.
+		else if (strcmpa((CHAR8 *)"trace", key) == 0) {
+			if (volume->is_boot_volume) {
+				trace = strcmpa((CHAR8 *)"off", value) != 0;
+			}
+		}
+		// Whether the menus may be drawn on the graphics output.
+		else if (strcmpa((CHAR8 *)"graphics", key) == 0) {
+			if (volume->is_boot_volume) {
+				ScreenAllowGraphics(strcmpa((CHAR8 *)"off", value) != 0);
+			}
+		}
+		// How the boot parameters are passed to GRUB: variables, loadoptions or both.
+		else if (strcmpa((CHAR8 *)"handoff", key) == 0) {
+			if (volume->is_boot_volume && !SetHandoffMode(value)) {
+				Print(L"Unrecognized handoff mode: %a.\n", value);
+			}
+		}
+		// The entry is meant for machines with the given SMBIOS names.
+		else if (strncmpa((CHAR8 *)"match_", key, 6) == 0 && conductor != previousTail) {
+			if (!AddHardwareRule(conductor->bootOption, key, value)) {
+				Print(L"Unrecognized configuration option: %a.\n", key);
 			}
 		}
 		// The user has put a given a distribution entry.
@@ -290,10 +644,13 @@ static void ReadConfigurationFile(const CHAR16 * const name) {
 			new->bootOption = AllocateZeroPool(sizeof(LinuxBootOption));
 			AllocateMemoryAndCopyChar8String(new->bootOption->name, value);
 			AllocateMemoryAndCopyChar8String(new->bootOption->iso_path, (CHAR8 *)"boot.iso"); // Set a default value.
+			new->bootOption->validation = ENTRY_VALID; // The default location is never checked.
+			new->bootOption->volume = volume;
 			
 			conductor->next = new;
 			new->next = NULL;
 			conductor = conductor->next; // subsequent operations affect the new link in the chain
+			distributionListTail = conductor;
 			distroCount++;
 		}
 		// The user has given us a distribution family.
@@ -310,6 +667,15 @@ static void ReadConfigurationFile(const CHAR16 * const name) {
 				strcmpa((CHAR8 *)"", conductor->bootOption->initrd_path) == 0) {
 				Print(L"Distribution family %a is not supported.\n", value);
 				
+				// A mistake in another volume's configuration shouldn't stop us from
+				// booting, so just leave its entries out.
+				if (!volume->is_boot_volume) {
+					previousTail->next = NULL;
+					distributionListTail = previousTail;
+					distroCount = previousCount;
+					return;
+				}
+				
 				FreePool(conductor->bootOption);
 				distributionListRoot = NULL;
 				return;
@@ -349,24 +715,129 @@ static void ReadConfigurationFile(const CHAR16 * const name) {
 		} else if (strcmpa((CHAR8 *)"initrd", key) == 0) {
 			AllocateMemoryAndCopyChar8String(conductor->bootOption->initrd_path, value);
 		} else if (strcmpa((CHAR8 *)"iso", key) == 0) {
-			strcpya(conductor->bootOption->iso_path, value);
+			AllocateMemoryAndCopyChar8String(conductor->bootOption->iso_path, value);
 			
-			CHAR16 *temp = ASCIItoUTF16(value, strlena(value));
-			if (!FileExists(root_dir, temp)) {
-				Print(L"Warning: ISO file %a not found.\n", value);
-			}
-			FreePool(temp);
+			// Whether the file exists is checked once the menu is up.
+			conductor->bootOption->validation = ENTRY_UNCHECKED;
 		} else if (strcmpa((CHAR8 *)"root", key) == 0) {
 			AllocateMemoryAndCopyChar8String(conductor->bootOption->boot_folder, value);
+		// The entry is booted through something other than GRUB.
+		} else if (strcmpa((CHAR8 *)"loader", key) == 0) {
+			if (strcmpa((CHAR8 *)"eltorito", value) == 0) {
+				conductor->bootOption->loader = LOADER_ELTORITO;
+			} else if (strcmpa((CHAR8 *)"uki", value) == 0) {
+				conductor->bootOption->loader = LOADER_UKI;
+			} else if (strcmpa((CHAR8 *)"grub", value) == 0) {
+				conductor->bootOption->loader = LOADER_GRUB;
+			} else {
+				Print(L"Unrecognized loader: %a.\n", value);
+			}
 		} else {
 			Print(L"Unrecognized configuration option: %a.\n", key);
 		}
 	}
 	
-	FreePool(contents);
+	if (!volume->is_boot_volume) {
+		DropUnbootableEntries(previousTail);
+	}
+	
 	//Print(L"Done reading configuration file.\n");
 }
 
+/*
+ * GRUB only finds ISO files on the boot volume, so entries on other volumes that would
+ * have to go through it are left out, unless the kernel cache can take them instead.
+ * Only the entries after the given one are looked at.
+ */
+static VOID DropUnbootableEntries(BootableLinuxDistro *previous) {
+	BootableLinuxDistro *entry;
+	
+	while ((entry = previous->next) != NULL) {
+		LinuxBootOption *option = entry->bootOption;
+		
+		if (option->loader != LOADER_GRUB || KernelCacheCanBoot(option)) {
+			previous = entry;
+			continue;
+		}
+		
+		Print(L"Leaving out %a: GRUB can only boot ISO files on the boot volume.\n", option->name);
+		previous->next = entry->next;
+		if (option->name) FreePool(option->name);
+		if (option->file_name) FreePool(option->file_name);
+		if (option->distro_family) FreePool(option->distro_family);
+		if (option->kernel_path) FreePool(option->kernel_path);
+		if (option->kernel_options) FreePool(option->kernel_options);
+		if (option->initrd_path) FreePool(option->initrd_path);
+		if (option->boot_folder) FreePool(option->boot_folder);
+		if (option->iso_path) FreePool(option->iso_path);
+		FreePool(option);
+		FreePool(entry);
+		distroCount--;
+	}
+	
+	distributionListTail = previous;
+}
+
+/*
+ * Adds an entry for every ISO file found in the volume's ISO directory whose family we
+ * can guess from its name, unless a configuration file already refers to it. The entry
+ * is described in the configuration file format and parsed like any other.
+ */
+static VOID AddISOEntries(Volume *volume) {
+	UINTN i;
+	
+	for (i = 0; i < volume->iso_file_count; i++) {
+		CHAR16 *file_name = volume->iso_files[i];
+		CHAR8 *name = UTF16toASCII(file_name, StrLen(file_name) + 1);
+		CHAR8 *family = name ? DistributionFamilyForFileName(name) : NULL;
+		CHAR8 *path = NULL, *description = NULL;
+		BootableLinuxDistro *conductor;
+		
+		if (!family) {
+			goto next;
+		}
+		
+		path = AllocatePool(strlena(name) + sizeof("/isos/"));
+		if (!path) {
+			goto next;
+		}
+		strcpya(path, (CHAR8 *)"/isos/");
+		strcata(path, name);
+		
+		for (conductor = distributionListRoot->next; conductor; conductor = conductor->next) {
+			if (conductor->bootOption->volume == volume && conductor->bootOption->iso_path &&
+				strcmpa(conductor->bootOption->iso_path, path) == 0) {
+				goto next;
+			}
+		}
+		
+		description = AllocatePool(strlena(name) + strlena(family) + strlena(path) + sizeof("entry \nfamily \niso \n"));
+		if (!description) {
+			goto next;
+		}
+		strcpya(description, (CHAR8 *)"entry ");
+		strcata(description, name);
+		strcata(description, (CHAR8 *)"\nfamily ");
+		strcata(description, family);
+		strcata(description, (CHAR8 *)"\niso ");
+		strcata(description, path);
+		strcata(description, (CHAR8 *)"\n");
+		ReadConfigurationFile(description, volume);
+		
+	next:
+		if (description) FreePool(description);
+		if (path) FreePool(path);
+		if (name) FreePool(name);
+		FreePool(file_name);
+	}
+	
+	if (volume->iso_files) {
+		FreePool(volume->iso_files);
+	}
+	volume->iso_files = NULL;
+	volume->iso_file_count = 0;
+}
+
 static EFI_STATUS console_text_mode(VOID) {
 	#define EFI_CONSOLE_CONTROL_PROTOCOL_GUID \
 		{ 0xf42f7782, 0x12e, 0x4c12, { 0x99, 0x56, 0x49, 0xf9, 0x43, 0x4, 0xf7, 0x21 } };
@@ -43,6 +43,22 @@ extern CHAR16 *banner;
 	} \
 	strcpya(dest, src); \
 
+/* Whether the files an entry refers to have been found on disk. */
+typedef enum {
+	ENTRY_UNCHECKED = 0,
+	ENTRY_VALID,
+	ENTRY_ISO_MISSING
+} EntryValidationState;
+
+/* How an entry is booted. */
+typedef enum {
+	LOADER_GRUB = 0, // Through GRUB, with the kernel and initrd paths of the family.
+	LOADER_ELTORITO, // Through the loader in the ISO file's own EFI boot image.
+	LOADER_UKI // The kernel is a unified kernel image, with its initrd and command line.
+} EntryLoader;
+
+struct Volume;
+
 typedef struct LinuxBootOption {
 	CHAR8 *name;
 	CHAR8 *file_name;
@@ -52,6 +68,11 @@ typedef struct LinuxBootOption {
 	CHAR8 *initrd_path;
 	CHAR8 *boot_folder;
 	CHAR8 *iso_path;
+	EntryValidationState validation;
+	struct Volume *volume; // The volume the entry was found on.
+	CHAR16 *label; // The entry's line in the selector, made when it is first shown.
+	UINT64 iso_size; // Known once the entry has been validated.
+	EntryLoader loader;
 } LinuxBootOption;
 
 typedef struct BootableLinuxDistro {
@@ -60,6 +81,8 @@ typedef struct BootableLinuxDistro {
 } BootableLinuxDistro;
 
 EFI_STATUS BootLinuxWithOptions(CHAR16 *, UINT16);
+LinuxBootOption* BootOptionAtIndex(UINTN);
+VOID SaveConsoleMode(UINTN);
 
 extern const EFI_GUID enterprise_variable_guid;
 extern const EFI_GUID grub_variable_guid;
@@ -68,5 +91,9 @@ extern UINTN numberOfDisplayRows, numberOfDisplayColoumns, highestModeNumberAvai
 extern BOOLEAN preset_options_array[PRESET_OPTIONS_SIZE];
 
 extern BootableLinuxDistro *distributionListRoot;
+extern BOOLEAN headless;
+extern BOOLEAN trace;
+extern EFI_HANDLE global_image;
+extern EFI_LOADED_IMAGE *this_image;
 
 #endif
@@ -0,0 +1,88 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "memory.h"
+
+static BOOLEAN automatic_toram = TRUE;
+static UINT64 toram_headroom = 2048ULL * 1024 * 1024;
+static UINT64 usable_memory = 0;
+
+/* Sets whether toram is added by itself. It isn't once the user has had a say. */
+VOID SetAutomaticToRAM(BOOLEAN enabled) {
+	automatic_toram = enabled;
+}
+
+/* Sets how many bytes have to be left once the ISO file has been copied to RAM. */
+VOID SetToRAMHeadroom(UINT64 bytes) {
+	toram_headroom = bytes;
+}
+
+/*
+ * Returns how many bytes of memory the kernel can use: everything that is free, or only
+ * in use until boot services are exited. The memory map is only read once.
+ */
+UINT64 UsableMemory(VOID) {
+	EFI_MEMORY_DESCRIPTOR *map;
+	UINTN entries, key, descriptor_size, i;
+	UINT32 descriptor_version;
+	
+	if (usable_memory) {
+		return usable_memory;
+	}
+	
+	map = LibMemoryMap(&entries, &key, &descriptor_size, &descriptor_version);
+	if (!map) {
+		return 0;
+	}
+	
+	// The descriptors may be larger than the structure we know about.
+	for (i = 0; i < entries; i++) {
+		EFI_MEMORY_DESCRIPTOR *descriptor = (EFI_MEMORY_DESCRIPTOR *)((UINT8 *)map + i * descriptor_size);
+		
+		switch (descriptor->Type) {
+			case EfiConventionalMemory:
+			case EfiBootServicesCode:
+			case EfiBootServicesData:
+			case EfiLoaderCode:
+			case EfiLoaderData:
+				usable_memory += descriptor->NumberOfPages * EFI_PAGE_SIZE;
+				break;
+			default:
+				break;
+		}
+	}
+	
+	FreePool(map);
+	return usable_memory;
+}
+
+/*
+ * Returns TRUE if the entry's ISO file and the headroom fit in memory. Entries that
+ * haven't been validated yet have no known size and are never copied.
+ */
+BOOLEAN ShouldCopyToRAM(LinuxBootOption *option) {
+	if (!automatic_toram || option->validation != ENTRY_VALID || option->iso_size == 0) {
+		return FALSE;
+	}
+	
+	return option->iso_size + toram_headroom <= UsableMemory();
+}
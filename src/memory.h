@@ -0,0 +1,34 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _memory_h
+#define _memory_h
+#include "main.h"
+
+/*
+ * Decides whether a distribution should be copied to RAM, by comparing the memory the
+ * kernel will get with the size of the ISO file plus some room for the live session.
+ */
+VOID SetAutomaticToRAM(BOOLEAN);
+VOID SetToRAMHeadroom(UINT64);
+UINT64 UsableMemory(VOID);
+BOOLEAN ShouldCopyToRAM(LinuxBootOption *);
+
+#endif
@@ -24,10 +24,19 @@
 #include "main.h"
 #include "utils.h"
 #include "distribution.h"
+#include "validation.h"
+#include "variables.h"
+#include "screen.h"
+#include "search.h"
+#include "lineedit.h"
+#include "memory.h"
 
 static void ShowAboutPage(VOID);
+
+#define BOOT_OPTIONS_LENGTH 512
+
 static CHAR16 *boot_options;
-static UINT8 distribution_id = -1;
+static UINT16 distribution_id = -1;
 
 #define KEYPRESS(keys, scan, uni) ((((UINT64)keys) << 32) | ((scan) << 16) | (uni))
 #define EFI_SHIFT_STATE_VALID           0x80000000
@@ -165,43 +174,300 @@ EFI_STATUS key_read(UINT64 *key, BOOLEAN wait) {
 	return EFI_SUCCESS;
 }
 
+/*
+ * Waits for a key press like key_read, but returns EFI_NOT_READY as soon as the given
+ * event is signalled instead, so that the caller can bring the screen up to date.
+ */
+EFI_STATUS key_read_or_event(UINT64 *key, EFI_EVENT event) {
+	EFI_EVENT events[2];
+	UINTN index;
+	EFI_STATUS err;
+	
+	if (!event) {
+		return key_read(key, TRUE);
+	}
+	
+	// There may already be a key waiting for us.
+	err = key_read(key, FALSE);
+	if (!EFI_ERROR(err)) {
+		return err;
+	}
+	
+	events[0] = ST->ConIn->WaitForKey;
+	events[1] = event;
+	err = uefi_call_wrapper(BS->WaitForEvent, 3, 2, events, &index);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	if (index == 1) {
+		return EFI_NOT_READY;
+	}
+	
+	return key_read(key, FALSE);
+}
+
+/* Returns the welcome line, formatted the first time it is needed. */
+static CHAR16* BannerText(VOID) {
+	static CHAR16 *text = NULL;
+	
+	if (!text) {
+		text = PoolPrint(banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+	}
+	return text ? text : L"Welcome to Enterprise!\n";
+}
+
+/* Adds the results of the background checks to the frame, once they're known. */
+static VOID DrawValidationNotices(VOID) {
+	if (!core_files.checked) {
+		return;
+	}
+	
+	if (!core_files.grub_found) {
+		ScreenPrint(SCREEN_ERROR, L"\n    Error: can't find GRUB bootloader! You won't be able to boot.\n");
+	}
+	
+	if (core_files.persistence_found) {
+		ScreenPrint(SCREEN_HIGHLIGHT, L"\n    Found a persistence file! You can enable persistence by " \
+							"selecting it in the Modify Boot Settings screen.\n");
+	}
+}
+
+/*
+ * Returns the line shown for an entry in the selector. The labels don't change once the
+ * configuration has been read, so each is only converted to UTF-16 once.
+ */
+static CHAR16* EntryLabel(LinuxBootOption *option, INTN number) {
+	if (!option->label) {
+		option->label = PoolPrint(L"    %d) %a", number, option->name);
+	}
+	return option->label ? option->label : L"    ?";
+}
+
+static EntrySearch *entry_search = NULL;
+
+/* Prints the selector on a single line, for serial consoles. */
+static VOID ShowCompactSelector(VOID) {
+	UINTN i;
+	
+	Print(L"\n");
+	for (i = 0; i < entry_search->count; i++) {
+		LinuxBootOption *option = entry_search->options[i];
+		if (option->name) {
+			// Leave out the indentation of the full screen selector.
+			Print(L"%s%s ", EntryLabel(option, i + 1) + 4,
+				option->validation == ENTRY_ISO_MISSING ? L" (missing)" : ShouldCopyToRAM(option) ? L" (toram)" : L"");
+		}
+	}
+	Print(L"other) reboot > ");
+}
+
+/* Adds one page of the entries matching the search to the frame. */
+static VOID DrawEntryPage(UINTN first, UINTN page_size, UINTN selected) {
+	UINTN i;
+	
+	if (entry_search->match_count == 0) {
+		ScreenPrint(SCREEN_NORMAL, L"    No entries match.\n");
+	}
+	
+	for (i = first; i < entry_search->match_count && i < first + page_size; i++) {
+		UINTN position = entry_search->matches[i];
+		LinuxBootOption *option = entry_search->options[position];
+		
+		ScreenPrint(i == selected ? SCREEN_HIGHLIGHT : SCREEN_NORMAL, EntryLabel(option, position + 1));
+		if (option->validation == ENTRY_ISO_MISSING) {
+			ScreenPrint(SCREEN_ERROR, L" (ISO file not found)");
+		} else if (ShouldCopyToRAM(option)) {
+			ScreenPrint(SCREEN_NORMAL, L" (toram)");
+		}
+		ScreenPrint(SCREEN_NORMAL, L"\n");
+	}
+}
+
+/*
+ * Lets the user pick an entry, by typing its number, by moving through the list with
+ * the arrow and page keys, or by typing part of its name to narrow the list down.
+ */
 EFI_STATUS DisplayDistributionSelector(struct BootableLinuxDistro *root, CHAR16 *bootOptions, BOOLEAN showBootOptions) {
 	EFI_STATUS err = EFI_SUCCESS;
+	BOOLEAN show_missing_notice = FALSE, show_list = TRUE;
+	UINTN selected = 0, first = 0, page_size, number = 0, digits = 0;
+	INTN index;
+	UINT64 key;
 	
-	uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK); // Set the text color.
-	uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut); // Clear the screen.
-	Print(banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH); // Print the welcome information.
-	DisplayColoredText(L"\n    Boot Selector:\n");
-	Print(L"    The following distributions have been detected on this USB.\n");
-	Print(L"    Press the key corresponding to the number of the option that you want.\n\n");
+	if (!entry_search) {
+		entry_search = BuildEntrySearch(root);
+		if (!entry_search) {
+			DisplayErrorText(L"Error: couldn't allocate memory for the boot selector.\n");
+			return EFI_OUT_OF_RESOURCES;
+		}
+	}
+	EntrySearchReset(entry_search);
+	
+	ScreenSetTop(0);
 	uefi_call_wrapper(ST->ConIn->Reset, 2, ST->ConIn, FALSE);
 	uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, FALSE); // Disable display of the cursor.
 	
-	// Print out the available Linux distributions on this USB.
-	BootableLinuxDistro *conductor = root->next; // The first item is blank. I'll fix this later.
-	INTN iteratorIndex = 0;
-	while (conductor != NULL) {
-		if (conductor->bootOption->name) {
-			Print(L"    %d) %a\n", ++iteratorIndex, conductor->bootOption->name);
-		} else ++iteratorIndex;
-		
-		conductor = conductor->next;
-	}
-	Print(L"\n    Press any other key to reboot the system.\n");
+	// Leave room for the lines above and below the list.
+	page_size = ScreenRows() > 15 ? ScreenRows() - 13 : 2;
 	
-	// Get the key press.
-	UINT64 key;
-	err = key_read(&key, TRUE);
-	INTN index = key - '0';
-	index--; // C arrays start at index 0, but we start counting at 1, so compensate.
-	
-	if (index > iteratorIndex) {
-		// Reboot the system.
-		err = uefi_call_wrapper(RT->ResetSystem, 4, EfiResetCold, EFI_SUCCESS, 0, NULL);
+	for (;;) {
+		if (headless) {
+			// On a serial console, the whole list goes on one line. It is only printed
+			// again when it has to be; otherwise just the typed number is echoed.
+			if (show_list) {
+				ShowCompactSelector();
+				show_list = FALSE;
+			}
+			err = key_read(&key, TRUE);
+		} else {
+			// Keep the selected entry on the page that is shown.
+			if (selected >= entry_search->match_count) {
+				selected = entry_search->match_count > 0 ? entry_search->match_count - 1 : 0;
+			}
+			if (selected < first) {
+				first = selected;
+			} else if (selected >= first + page_size) {
+				first = selected - page_size + 1;
+			}
+			
+			ScreenBegin();
+			ScreenPrint(SCREEN_NORMAL, BannerText()); // Print the welcome information.
+			ScreenPrint(SCREEN_HIGHLIGHT, L"\n    Boot Selector:\n");
+			ScreenPrint(SCREEN_NORMAL, L"    The following distributions have been detected on this USB.\n");
+			ScreenPrint(SCREEN_NORMAL, L"    Type an entry's number or part of its name, or use the arrow keys.\n\n");
+			DrawEntryPage(first, page_size, selected);
+			
+			// The typed number is passed last, so the format without it can leave it out.
+			CHAR16 *status = PoolPrint(digits > 0 ?
+				L"\n    Search: %a    Entries %d-%d of %d    Number: %d\n" :
+				L"\n    Search: %a    Entries %d-%d of %d\n",
+				entry_search->query, entry_search->match_count > 0 ? first + 1 : 0,
+				first + page_size < entry_search->match_count ? first + page_size : entry_search->match_count,
+				entry_search->match_count, number);
+			if (status) {
+				ScreenPrint(SCREEN_NORMAL, status);
+				FreePool(status);
+			}
+			ScreenPrint(SCREEN_NORMAL, L"    Press Enter to boot the highlighted entry, or Escape to reboot.\n");
+			
+			CHAR16 *memory = PoolPrint(L"    %ld MB of memory; entries marked (toram) will be copied to RAM.\n",
+				UsableMemory() / (1024 * 1024));
+			if (memory) {
+				ScreenPrint(SCREEN_NORMAL, memory);
+				FreePool(memory);
+			}
+			if (show_missing_notice) {
+				ScreenPrint(SCREEN_ERROR, L"\n    The ISO file for this entry can't be found. Press any key to go back.");
+			}
+			ScreenPresent();
+			
+			// Get the key press. Redraw the list if the background checks find a problem.
+			err = key_read_or_event(&key, validation_event);
+			if (err == EFI_NOT_READY) {
+				continue;
+			}
+		}
 		
-		// Should never get here unless there's an error.
-		Print(L"Error calling ResetSystem: %r", err);
-		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		if (EFI_ERROR(err)) {
+			continue;
+		}
+		if (show_missing_notice) {
+			show_missing_notice = FALSE;
+			continue;
+		}
+		
+		UINT16 scan = (key >> 16) & 0xffff;
+		CHAR16 c = key & 0xffff;
+		index = -1;
+		
+		if (c >= '0' && c <= '9' && (digits > 0 || c != '0') && entry_search->query_length == 0) {
+			number = number * 10 + (c - '0');
+			digits++;
+			if (headless) {
+				Print(L"%c", c);
+			}
+			
+			// Once no other entry's number starts with these digits, don't wait for Enter.
+			if (number * 10 <= entry_search->count) {
+				continue;
+			}
+			index = number - 1;
+		} else if (c == CHAR_CARRIAGE_RETURN) {
+			if (digits > 0) {
+				index = number - 1;
+			} else if (entry_search->match_count > 0) {
+				index = entry_search->matches[selected];
+			} else {
+				continue;
+			}
+		} else if (c == CHAR_BACKSPACE) {
+			if (digits > 0) {
+				if (headless) {
+					Print(L"\b \b");
+				}
+				number /= 10;
+				digits--;
+			} else {
+				EntrySearchBackspace(entry_search);
+				selected = first = 0;
+			}
+			continue;
+		} else if (scan == SCAN_UP) {
+			selected = selected > 0 ? selected - 1 : 0;
+			continue;
+		} else if (scan == SCAN_DOWN) {
+			selected++;
+			continue;
+		} else if (scan == SCAN_PAGE_UP) {
+			selected = selected > page_size ? selected - page_size : 0;
+			continue;
+		} else if (scan == SCAN_PAGE_DOWN) {
+			selected += page_size;
+			continue;
+		} else if (scan == SCAN_HOME) {
+			selected = 0;
+			continue;
+		} else if (scan == SCAN_END) {
+			selected = entry_search->match_count;
+			continue;
+		} else if (scan == SCAN_ESC && (digits > 0 || entry_search->query_length > 0)) {
+			EntrySearchReset(entry_search);
+			number = digits = selected = first = 0;
+			show_list = TRUE;
+			continue;
+		} else if (!headless && scan == SCAN_NULL && EntrySearchAppend(entry_search, c)) {
+			number = digits = selected = first = 0;
+			continue;
+		} else {
+			// Reboot the system.
+			VariableFlush();
+			err = uefi_call_wrapper(RT->ResetSystem, 4, EfiResetCold, EFI_SUCCESS, 0, NULL);
+			
+			// Should never get here unless there's an error.
+			Print(L"Error calling ResetSystem: %r", err);
+			uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+			return err;
+		}
+		
+		number = digits = 0;
+		if (index < 0 || (UINTN)index >= entry_search->count || !entry_search->options[index]->name) {
+			show_list = TRUE;
+			continue;
+		}
+		
+		// Don't go any further with an entry whose files aren't there.
+		if (ValidateEntry(entry_search->options[index]) == ENTRY_ISO_MISSING) {
+			if (headless) {
+				DisplayErrorText(L"\nISO file not found.");
+				show_list = TRUE;
+			} else {
+				show_missing_notice = TRUE;
+			}
+			continue;
+		}
+		
+		break;
 	}
 	
 	if (showBootOptions) {
@@ -218,32 +484,48 @@ EFI_STATUS DisplayDistributionSelector(struct BootableLinuxDistro *root, CHAR16
 EFI_STATUS DisplayMenu(VOID) {
 	EFI_STATUS err;
 	UINT64 key;
-	boot_options = AllocateZeroPool(sizeof(CHAR16) * 150);
+	boot_options = AllocateZeroPool(sizeof(CHAR16) * BOOT_OPTIONS_LENGTH);
 	if (!boot_options) {
 		DisplayErrorText(L"Failed to allocate memory for boot options string.");
 		return EFI_OUT_OF_RESOURCES;
 	}
 	
+	// Keep whatever was printed while starting up above the menu.
+	UINTN top = ScreenSetTop(ST->ConOut->Mode->CursorRow);
+	
 	start:
 	
 	/*
-	 * Give the user some information as to what they can do at this point.
+	 * Give the user some information as to what they can do at this point. Show whatever
+	 * the background checks find while we wait for the user.
 	 */
-	DisplayColoredText(L"\n\n    Available boot options:\n");
-	Print(L"    Press the key corresponding to the number of the option that you want.\n");
-	Print(L"\n    1) Boot Linux from ISO file\n");
-	Print(L"    2) Modify Linux kernel boot options (advanced!)\n");
-	Print(L"\n    Press any other key to reboot the system.\n");
+	if (headless) {
+		Print(L"\nEnterprise %d.%d.%d: 1) boot  2) boot with options  other) reboot > ",
+			VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+		err = key_read(&key, TRUE);
+	} else do {
+		ScreenBegin();
+		if (top == 0) {
+			// Nothing is left above the menu, so it needs a banner of its own.
+			ScreenPrint(SCREEN_NORMAL, BannerText());
+		}
+		ScreenPrint(SCREEN_HIGHLIGHT, L"\n\n    Available boot options:\n");
+		ScreenPrint(SCREEN_NORMAL, L"    Press the key corresponding to the number of the option that you want.\n");
+		ScreenPrint(SCREEN_NORMAL, L"\n    1) Boot Linux from ISO file\n");
+		ScreenPrint(SCREEN_NORMAL, L"    2) Modify Linux kernel boot options (advanced!)\n");
+		ScreenPrint(SCREEN_NORMAL, L"\n    Press any other key to reboot the system.\n");
+		DrawValidationNotices();
+		ScreenPresent();
+	} while ((err = key_read_or_event(&key, validation_event)) == EFI_NOT_READY);
 	
-	err = key_read(&key, TRUE);
 	if (key == '1') {
-		DisplayDistributionSelector(distributionListRoot, L"", FALSE);
+		DisplayDistributionSelector(distributionListRoot, boot_options, FALSE);
 	} else if (key == '2') {
-		DisplayDistributionSelector(distributionListRoot, L"", TRUE);
+		DisplayDistributionSelector(distributionListRoot, boot_options, TRUE);
 	} else if (key == 1507328) { // Escape key
 		ShowAboutPage();
-		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
-		Print(banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+		top = ScreenSetTop(0);
+		ScreenInvalidate();
 		goto start;
 	} else if (key == 720896) { // F1 key
 		// Reset to use the default screen resolution. This is provided as a
@@ -251,10 +533,14 @@ EFI_STATUS DisplayMenu(VOID) {
 		uefi_call_wrapper(ST->ConOut->SetMode, 2, ST->ConOut, 0);
 		numberOfDisplayRows = 80;
 		numberOfDisplayColoumns = 25;
+		SaveConsoleMode(0);
 		uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, FALSE);
+		top = ScreenSetTop(0);
+		ScreenInvalidate();
 		goto start;
 	} else {
 		// Reboot the system.
+		VariableFlush();
 		err = uefi_call_wrapper(RT->ResetSystem, 4, EfiResetCold, EFI_SUCCESS, 0, NULL);
 		
 		// Should never get here unless there's an error.
@@ -289,12 +575,43 @@ static void ShowAboutPage(VOID) {
 
 static int options_array[20];
 
-#define OPTION(string, id) \
-	if (options_array[id]) { \
-		DisplayColoredText(string); \
-	} else { \
-		Print(string); \
+// The kernel parameters of the toggleable options, in menu order.
+static CHAR16 *option_parameters[] = {
+	L"nomodeset", L"acpi=off", L"noefi", L"vga=ask", L"persistent", L"toram", L"debug", L"gpt", NULL
+};
+
+/*
+ * Turns on the toggles for the options in the given list of kernel parameters, which are
+ * separated by spaces. Parameters without a toggle are left alone.
+ */
+VOID PresetKernelOptions(CHAR8 *parameters) {
+	CHAR16 *list = ASCIItoUTF16(parameters, strlena(parameters));
+	CHAR16 *start, *end;
+	UINTN i;
+	
+	if (!list) {
+		return;
 	}
+	
+	for (start = list; *start; start = end) {
+		for (; *start == ' '; start++);
+		for (end = start; *end && *end != ' '; end++);
+		
+		CHAR16 separator = *end;
+		*end = '\0';
+		for (i = 0; option_parameters[i]; i++) {
+			if (StrCmp(option_parameters[i], start) == 0) {
+				preset_options_array[i] = TRUE;
+			}
+		}
+		*end = separator;
+	}
+	
+	FreePool(list);
+}
+
+#define OPTION(string, id) \
+	ScreenPrint(options_array[id] ? SCREEN_HIGHLIGHT : SCREEN_NORMAL, string);
 
 EFI_STATUS ConfigureKernel(CHAR16 *options, BOOLEAN preset_options[], int preset_options_length) {
 	UINT64 key;
@@ -306,36 +623,67 @@ EFI_STATUS ConfigureKernel(CHAR16 *options, BOOLEAN preset_options[], int preset
 	// we can directly pass it to the kernel.
 	StrCat(options, boot_options);
 	
+	// The presets depend on files found on disk, so wait for those checks.
+	ValidateCoreFiles();
+	
 	// Copy everything from our preset options array into our options array.
 	int i;
 	for (i = 0; i < preset_options_length; i++) {
 		options_array[i] = preset_options[i];
 	}
 	
+	// Suggest toram if the distribution fits in memory. From here on, the toggle decides.
+	LinuxBootOption *selected = BootOptionAtIndex(distribution_id);
+	if (selected && ShouldCopyToRAM(selected)) {
+		options_array[5] = TRUE;
+	}
+	SetAutomaticToRAM(FALSE);
+	
+	ScreenSetTop(0);
+	if (headless) {
+		Print(L"\n1 nomodeset  2 acpi=off  3 noefi  4 vga=ask  5 persistent  6 toram  7 debug  8 gpt  " \
+			"9 custom  0 boot\n");
+	}
+	
 	// Enter a loop where we show the menu.
 	do {
-		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
 		/*
 		 * Configure the boot options to the Linux kernel. Let the user select any option
 		 * that they think might facilitate booting Linux and add it to the options
 		 * string once they press 0.
 		 */
-		Print(banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
-		DisplayColoredText(L"\n    Configure Kernel Options:\n");
-		Print(L"    Press the key corresponding to the number of the option to toggle.\n");
-		OPTION(L"\n    1) nomodeset - Disable kernel mode setting.", 0);
-		OPTION(L"\n    2) acpi=off - Disable ACPI.", 1);
-		OPTION(L"\n    3) noefi - Disable EFI runtime services support.", 2);
-		OPTION(L"\n    4) vga=ask - Show a menu of supported video modes.", 3);
-		OPTION(L"\n    5) persistent - Make any changes to the flash storage persist.", 4);
-		OPTION(L"\n    6) toram - Keep the entire distribution in RAM to minimize disk usage.", 5);
-		OPTION(L"\n    7) debug - Enable kernel debugging.", 6);
-		OPTION(L"\n    8) gpt - Forces disk with valid GPT signature but invalid Protective MBR" \
-				" to be treated as GPT (useful for installing Linux on a Mac drive).", 7);
-		OPTION(L"\n    9) Custom...", 8);
-		if (StrLen(options) > 0) Print(L" %s", options);
-
-		Print(L"\n\n    0) Boot with selected options.\n");
+		if (headless) {
+			// Only print which options are on, on a line of its own.
+			Print(L"\non:");
+			for (i = 0; option_parameters[i]; i++) {
+				if (options_array[i]) {
+					Print(L" %s", option_parameters[i]);
+				}
+			}
+			Print(L" %s> ", options);
+		} else {
+			ScreenBegin();
+			ScreenPrint(SCREEN_NORMAL, BannerText());
+			ScreenPrint(SCREEN_HIGHLIGHT, L"\n    Configure Kernel Options:\n");
+			ScreenPrint(SCREEN_NORMAL, L"    Press the key corresponding to the number of the option to toggle.\n");
+			OPTION(L"\n    1) nomodeset - Disable kernel mode setting.", 0);
+			OPTION(L"\n    2) acpi=off - Disable ACPI.", 1);
+			OPTION(L"\n    3) noefi - Disable EFI runtime services support.", 2);
+			OPTION(L"\n    4) vga=ask - Show a menu of supported video modes.", 3);
+			OPTION(L"\n    5) persistent - Make any changes to the flash storage persist.", 4);
+			OPTION(L"\n    6) toram - Keep the entire distribution in RAM to minimize disk usage.", 5);
+			OPTION(L"\n    7) debug - Enable kernel debugging.", 6);
+			OPTION(L"\n    8) gpt - Forces disk with valid GPT signature but invalid Protective MBR" \
+					" to be treated as GPT (useful for installing Linux on a Mac drive).", 7);
+			OPTION(L"\n    9) Custom...", 8);
+			if (StrLen(options) > 0) {
+				ScreenPrint(SCREEN_NORMAL, L" ");
+				ScreenPrint(SCREEN_NORMAL, options);
+			}
+		
+			ScreenPrint(SCREEN_NORMAL, L"\n\n    0) Boot with selected options.\n");
+			ScreenPresent();
+		}
 		
 		err = key_read(&key, TRUE);
 		if (EFI_ERROR(err)) {
@@ -350,65 +698,59 @@ EFI_STATUS ConfigureKernel(CHAR16 *options, BOOLEAN preset_options[], int preset
 		// toggled, and not if option 9 is selected. Option 9 should only be
 		// highlighted if the user types something.
 		if (index == 9) {
-			uefi_call_wrapper(ST->ConOut->SetCursorPosition, 2, 0, numberOfDisplayRows - 1);
-			uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, TRUE);
+			// The input goes through the text console, so use its bottom row.
+			UINTN text_columns, input_row = 25;
+			if (!headless) {
+				uefi_call_wrapper(ST->ConOut->QueryMode, 4, ST->ConOut, ST->ConOut->Mode->Mode, &text_columns, &input_row);
+				input_row--;
+				uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, 0, input_row);
+				uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, TRUE);
+			}
 			Print(L"> ");
 
-			CHAR16 *input = NULL;
-			EFI_STATUS err = ReadStringFromKeyboard(&input);
-			if (!EFI_ERROR(err)) StrCat(options, input);
-			FreePool(input);
-
-			uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, 0, 0);
-			uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, FALSE);
-
+			// Leave room in the option line for the toggled options, a separator and the
+			// terminator.
+			UINTN used = StrLen(options) + 2;
+			for (i = 0; option_parameters[i]; i++) {
+				used += StrLen(option_parameters[i]) + 1;
+			}
+			
+			CHAR16 input[BOOT_OPTIONS_LENGTH];
+			UINTN room = used < BOOT_OPTIONS_LENGTH ? BOOT_OPTIONS_LENGTH - used : 0;
+			EFI_STATUS err = ReadLine(input, room, L"Enterprise_ParameterHistory");
+			if (!headless) {
+				uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, 0, 0);
+				uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, FALSE);
+			}
+			
 			// Highlight the ninth option if the user has entered an option.
-			if (StrLen(input) > 0) {
+			if (!EFI_ERROR(err) && StrLen(input) > 0) {
+				StrCat(options, input);
+				StrCat(options, L" ");
 				options_array[8] = TRUE;
 			}
-		} else {
+			
+			// The input was echoed on the bottom row behind the screen's back, and the
+			// line break after it scrolled everything up.
+			ScreenInvalidate();
+		} else if (index >= 1 && index <= 8) {
 			options_array[index - 1] = !options_array[index - 1];
 		}
 	} while(key != '0');
 	
 	// Now concatenate the individual options onto the option line.
-	// I'm investigating a better way to do this.
-	if (options_array[0]) {
-		StrCat(options, L"nomodeset ");
-	}
-	
-	if (options_array[1]) {
-		StrCat(options, L"acpi=off ");
-	}
-	
-	if (options_array[2]) {
-		StrCat(options, L"noefi ");
-	}
-	
-	if (options_array[3]) {
-		StrCat(options, L"vga=ask ");
-	}
-	
-	if (options_array[4]) {
-		StrCat(options, L"persistent ");
-	}
-	
-	if (options_array[5]) {
-		StrCat(options, L"toram ");
-	}
-	
-	if (options_array[6]) {
-		StrCat(options, L"debug ");
-	}
-	
-	if (options_array[7]) {
-		StrCat(options, L"gpt ");
+	for (i = 0; option_parameters[i]; i++) {
+		if (options_array[i]) {
+			StrCat(options, option_parameters[i]);
+			StrCat(options, L" ");
+		}
 	}
 	
 	BootLinuxWithOptions(options, distribution_id);
 	
 	// Shouldn't get here unless something went wrong with the boot process.
 	uefi_call_wrapper(BS->Stall, 1, 3 * 1000);
+	VariableFlush();
 	uefi_call_wrapper(RT->ResetSystem, 4, EfiResetCold, EFI_SUCCESS, 0, NULL);
 	return EFI_LOAD_ERROR;
 }
@@ -22,9 +22,11 @@
 #include "main.h"
 
 EFI_STATUS key_read(UINT64 *key, BOOLEAN wait);
+EFI_STATUS key_read_or_event(UINT64 *, EFI_EVENT);
 
 EFI_STATUS DisplayMenu(void);
 EFI_STATUS DisplayDistributionSelector(struct BootableLinuxDistro *, CHAR16 *, BOOLEAN);
 EFI_STATUS ConfigureKernel(CHAR16 *, BOOLEAN[], int);
+VOID PresetKernelOptions(CHAR8 *);
 
 #endif
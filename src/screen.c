@@ -0,0 +1,307 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "screen.h"
+#include "graphics.h"
+
+/*
+ * The front buffer holds what we know to be on the screen and the back buffer the frame
+ * being drawn. Rows of the front buffer that aren't known are written out in full.
+ */
+static CHAR16 *front_chars = NULL, *back_chars = NULL;
+static UINT8 *front_attributes = NULL, *back_attributes = NULL;
+static BOOLEAN *row_known = NULL;
+static CHAR16 *run = NULL;
+
+static UINTN columns = 0, rows = 0;
+static UINTN top = 0; // Rows above this one are left alone.
+static UINTN cursor_column = 0, cursor_row = 0;
+static INTN screen_mode = -1;
+
+// Whether frames go to the graphics output instead of the text console.
+static BOOLEAN graphics_allowed = TRUE, graphics = FALSE, clear_pending = FALSE;
+
+static VOID FreeBuffers(VOID) {
+	if (front_chars) FreePool(front_chars);
+	if (back_chars) FreePool(back_chars);
+	if (front_attributes) FreePool(front_attributes);
+	if (back_attributes) FreePool(back_attributes);
+	if (row_known) FreePool(row_known);
+	if (run) FreePool(run);
+	
+	front_chars = back_chars = run = NULL;
+	front_attributes = back_attributes = NULL;
+	row_known = NULL;
+	columns = rows = 0;
+}
+
+/* Lets frames be drawn on the graphics output, if there is one. Set by the configuration. */
+VOID ScreenAllowGraphics(BOOLEAN allowed) {
+	graphics_allowed = allowed;
+	screen_mode = -1;
+}
+
+/*
+ * Sizes the buffers for the current console mode, which the F1 key can change. Frames are
+ * drawn on the graphics output if there is one, and on the text console otherwise.
+ */
+static BOOLEAN UpdateDimensions(VOID) {
+	UINTN new_columns, new_rows, cells;
+	
+	if (screen_mode == ST->ConOut->Mode->Mode && front_chars && (!graphics || !GraphicsModeChanged())) {
+		return TRUE;
+	}
+	
+	FreeBuffers();
+	screen_mode = ST->ConOut->Mode->Mode;
+	graphics = graphics_allowed && GraphicsInitialize(&new_columns, &new_rows);
+	if (graphics) {
+		// Whatever the text console left on the screen doesn't line up with our cells.
+		clear_pending = TRUE;
+		top = 0;
+	} else if (EFI_ERROR(uefi_call_wrapper(ST->ConOut->QueryMode, 4, ST->ConOut, screen_mode, &new_columns, &new_rows))) {
+		new_columns = 80;
+		new_rows = 25;
+	}
+	
+	cells = new_columns * new_rows;
+	front_chars = AllocatePool(cells * sizeof(CHAR16));
+	back_chars = AllocatePool(cells * sizeof(CHAR16));
+	front_attributes = AllocatePool(cells);
+	back_attributes = AllocatePool(cells);
+	row_known = AllocateZeroPool(new_rows * sizeof(BOOLEAN));
+	run = AllocatePool((new_columns + 1) * sizeof(CHAR16));
+	if (!front_chars || !back_chars || !front_attributes || !back_attributes || !row_known || !run) {
+		FreeBuffers();
+		screen_mode = -1;
+		return FALSE;
+	}
+	
+	columns = new_columns;
+	rows = new_rows;
+	if (top >= rows) {
+		top = 0;
+	}
+	return TRUE;
+}
+
+UINTN ScreenColumns(VOID) {
+	UpdateDimensions();
+	return columns;
+}
+
+UINTN ScreenRows(VOID) {
+	UpdateDimensions();
+	return rows;
+}
+
+/*
+ * Sets the first row that frames are drawn at, so that what was printed above it stays
+ * on the screen, and returns the row actually used. Rows that the frames now cover are
+ * redrawn in full.
+ */
+UINTN ScreenSetTop(UINTN row) {
+	UINTN i;
+	
+	if (!UpdateDimensions()) {
+		return 0;
+	}
+	
+	// Leave enough room for the menus. The text above can't be kept in graphics mode,
+	// since it was printed on the text console's grid.
+	if (row > rows / 2 || graphics) {
+		row = 0;
+	}
+	
+	for (i = row; i < top; i++) {
+		row_known[i] = FALSE;
+	}
+	top = row;
+	return top;
+}
+
+/* Starts a new, empty frame with the cursor at the top row. */
+VOID ScreenBegin(VOID) {
+	UINTN i;
+	
+	if (!UpdateDimensions()) {
+		return;
+	}
+	
+	for (i = top * columns; i < rows * columns; i++) {
+		back_chars[i] = L' ';
+		back_attributes[i] = SCREEN_NORMAL;
+	}
+	
+	cursor_column = 0;
+	cursor_row = top;
+}
+
+/* Adds text to the frame. Lines that are too long wrap like they would on the console. */
+VOID ScreenPrint(UINT8 attribute, CHAR16 *string) {
+	if (!front_chars) {
+		// Without a shadow buffer, fall back to printing straight away.
+		uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, attribute);
+		Print(L"%s", string);
+		uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, SCREEN_NORMAL);
+		return;
+	}
+	
+	for (; *string; string++) {
+		if (*string == L'\n') {
+			cursor_column = 0;
+			cursor_row++;
+			continue;
+		}
+		
+		if (cursor_column == columns) {
+			cursor_column = 0;
+			cursor_row++;
+		}
+		if (cursor_row >= rows) {
+			return;
+		}
+		
+		back_chars[cursor_row * columns + cursor_column] = *string;
+		back_attributes[cursor_row * columns + cursor_column] = attribute;
+		cursor_column++;
+	}
+}
+
+/*
+ * Sends the changed part of each row to the console. Each row's changes are written as
+ * one span, split only where the attribute changes. In graphics mode, each span is one
+ * rectangle copied to the framebuffer.
+ */
+VOID ScreenPresent(VOID) {
+	UINTN row, first, last, i, length;
+	INTN current_attribute = -1;
+	
+	if (!front_chars) {
+		return;
+	}
+	
+	if (graphics && clear_pending) {
+		GraphicsClear();
+		clear_pending = FALSE;
+	}
+	
+	for (row = top; row < rows; row++) {
+		CHAR16 *front = front_chars + row * columns, *back = back_chars + row * columns;
+		UINT8 *front_attr = front_attributes + row * columns, *back_attr = back_attributes + row * columns;
+		
+		// Writing the last cell of the text screen would scroll it.
+		UINTN width = row == rows - 1 && !graphics ? columns - 1 : columns;
+		
+		if (row_known[row]) {
+			for (first = 0; first < width && front[first] == back[first] && front_attr[first] == back_attr[first]; first++);
+			if (first == width) {
+				continue;
+			}
+			for (last = width - 1; last > first && front[last] == back[last] && front_attr[last] == back_attr[last]; last--);
+		} else {
+			first = 0;
+			last = width - 1;
+		}
+		
+		if (graphics) {
+			GraphicsDrawCells(row, first, last - first + 1, back + first, back_attr + first);
+			i = last + 1;
+		} else {
+			uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, first, row);
+			i = first;
+		}
+		for (; i <= last; i += length) {
+			if (back_attr[i] != current_attribute) {
+				current_attribute = back_attr[i];
+				uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, current_attribute);
+			}
+			
+			for (length = 0; i + length <= last && back_attr[i + length] == current_attribute; length++) {
+				run[length] = back[i + length];
+			}
+			run[length] = L'\0';
+			uefi_call_wrapper(ST->ConOut->OutputString, 2, ST->ConOut, run);
+		}
+		
+		CopyMem(front + first, back + first, (last - first + 1) * sizeof(CHAR16));
+		CopyMem(front_attr + first, back_attr + first, last - first + 1);
+		row_known[row] = TRUE;
+	}
+	
+	if (current_attribute != -1 && current_attribute != SCREEN_NORMAL) {
+		uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, SCREEN_NORMAL);
+	}
+}
+
+/* Forgets what is on the screen, so that the next frame is drawn in full. */
+VOID ScreenInvalidate(VOID) {
+	UINTN i;
+	
+	if (!row_known) {
+		return;
+	}
+	
+	for (i = 0; i < rows; i++) {
+		row_known[i] = FALSE;
+	}
+	clear_pending = graphics;
+}
+
+/*
+ * Returns TRUE if every console output device with a device path is a serial port, in
+ * which case nobody is looking at a screen and output should be kept to a minimum.
+ */
+BOOLEAN ScreenIsSerialOnly(VOID) {
+	EFI_HANDLE *handles = NULL;
+	UINTN count = 0, i;
+	BOOLEAN serial_found = FALSE, other_found = FALSE;
+	
+	if (EFI_ERROR(LibLocateHandle(ByProtocol, &TextOutProtocol, NULL, &count, &handles))) {
+		return FALSE;
+	}
+	
+	for (i = 0; i < count && !other_found; i++) {
+		EFI_DEVICE_PATH *node = DevicePathFromHandle(handles[i]);
+		BOOLEAN serial = FALSE;
+		
+		// Consoles without a device path, like the console splitter, aren't devices.
+		if (!node) {
+			continue;
+		}
+		
+		for (; !IsDevicePathEnd(node); node = NextDevicePathNode(node)) {
+			if (DevicePathType(node) == MESSAGING_DEVICE_PATH && DevicePathSubType(node) == MSG_UART_DP) {
+				serial = TRUE;
+			}
+		}
+		
+		if (serial) {
+			serial_found = TRUE;
+		} else {
+			other_found = TRUE;
+		}
+	}
+	
+	FreePool(handles);
+	return serial_found && !other_found;
+}
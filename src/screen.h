@@ -0,0 +1,45 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _screen_h
+#define _screen_h
+#include "main.h"
+
+/*
+ * The menus are drawn into a shadow copy of the text screen, one frame at a time, and
+ * ScreenPresent only sends the cells that differ from what is already on the screen.
+ * Anything drawn behind the screen's back has to be followed by ScreenInvalidate.
+ * Frames are drawn on the graphics output when there is one.
+ */
+#define SCREEN_NORMAL (EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK)
+#define SCREEN_HIGHLIGHT (EFI_YELLOW|EFI_BACKGROUND_BLACK)
+#define SCREEN_ERROR (EFI_RED|EFI_BACKGROUND_BLACK)
+
+VOID ScreenAllowGraphics(BOOLEAN);
+UINTN ScreenSetTop(UINTN);
+VOID ScreenBegin(VOID);
+VOID ScreenPrint(UINT8, CHAR16 *);
+VOID ScreenPresent(VOID);
+VOID ScreenInvalidate(VOID);
+UINTN ScreenColumns(VOID);
+UINTN ScreenRows(VOID);
+BOOLEAN ScreenIsSerialOnly(VOID);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "search.h"
+
+static CHAR8 ToLower(CHAR8 c) {
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/* Returns TRUE if needle occurs in haystack; both are already lowercase. */
+static BOOLEAN ContainsLowercase(CHAR8 *haystack, UINTN length, CHAR8 *needle, UINTN needle_length) {
+	UINTN i;
+	
+	if (needle_length == 0) {
+		return TRUE;
+	}
+	
+	for (i = 0; i + needle_length <= length; i++) {
+		if (haystack[i] == needle[0] && CompareMem(haystack + i, needle, needle_length) == 0) {
+			return TRUE;
+		}
+	}
+	
+	return FALSE;
+}
+
+/* Makes every named entry match, as with an empty query. */
+VOID EntrySearchReset(EntrySearch *search) {
+	UINTN i;
+	
+	search->query_length = 0;
+	search->query[0] = '\0';
+	search->match_count = 0;
+	for (i = 0; i < search->count; i++) {
+		if (search->names[i]) {
+			search->matches[search->match_count++] = i;
+		}
+	}
+}
+
+/*
+ * Builds the search index for the entry list. The lowercase names are stored one after
+ * the other in a single buffer.
+ */
+EntrySearch* BuildEntrySearch(BootableLinuxDistro *root) {
+	EntrySearch *search;
+	BootableLinuxDistro *conductor;
+	UINTN count = 0, total = 0, i, j;
+	CHAR8 *buffer;
+	
+	for (conductor = root->next; conductor; conductor = conductor->next) {
+		count++;
+		if (conductor->bootOption->name) {
+			total += strlena(conductor->bootOption->name) + 1;
+		}
+	}
+	
+	search = AllocateZeroPool(sizeof(EntrySearch));
+	if (!search) {
+		return NULL;
+	}
+	
+	search->count = count;
+	search->options = AllocateZeroPool((count + 1) * sizeof(LinuxBootOption *));
+	search->names = AllocateZeroPool((count + 1) * sizeof(CHAR8 *));
+	search->lengths = AllocateZeroPool((count + 1) * sizeof(UINTN));
+	search->matches = AllocateZeroPool((count + 1) * sizeof(UINTN));
+	buffer = AllocatePool(total + 1);
+	if (!search->options || !search->names || !search->lengths || !search->matches || !buffer) {
+		if (search->options) FreePool(search->options);
+		if (search->names) FreePool(search->names);
+		if (search->lengths) FreePool(search->lengths);
+		if (search->matches) FreePool(search->matches);
+		if (buffer) FreePool(buffer);
+		FreePool(search);
+		return NULL;
+	}
+	
+	for (i = 0, conductor = root->next; conductor; conductor = conductor->next, i++) {
+		CHAR8 *name = conductor->bootOption->name;
+		
+		search->options[i] = conductor->bootOption;
+		if (!name) {
+			continue;
+		}
+		
+		search->names[i] = buffer;
+		for (j = 0; name[j]; j++) {
+			*buffer++ = ToLower(name[j]);
+		}
+		*buffer++ = '\0';
+		search->lengths[i] = j;
+	}
+	
+	EntrySearchReset(search);
+	return search;
+}
+
+/*
+ * Adds a character to the query. A longer query can only match fewer entries, so only
+ * the current matches are checked again. Returns FALSE if the character isn't printable;
+ * characters past the longest query are ignored.
+ */
+BOOLEAN EntrySearchAppend(EntrySearch *search, CHAR16 c) {
+	UINTN i, kept = 0;
+	
+	if (c < 0x20 || c > 0x7e) {
+		return FALSE;
+	} else if (search->query_length == ENTRY_SEARCH_MAX_QUERY) {
+		return TRUE;
+	}
+	
+	search->query[search->query_length++] = ToLower((CHAR8)c);
+	search->query[search->query_length] = '\0';
+	
+	for (i = 0; i < search->match_count; i++) {
+		UINTN position = search->matches[i];
+		if (ContainsLowercase(search->names[position], search->lengths[position], search->query, search->query_length)) {
+			search->matches[kept++] = position;
+		}
+	}
+	
+	search->match_count = kept;
+	return TRUE;
+}
+
+/* Removes the last character of the query and checks every entry against what's left. */
+VOID EntrySearchBackspace(EntrySearch *search) {
+	CHAR8 query[ENTRY_SEARCH_MAX_QUERY + 1];
+	UINTN length = search->query_length, i;
+	
+	if (length == 0) {
+		return;
+	}
+	
+	CopyMem(query, search->query, length - 1);
+	EntrySearchReset(search);
+	for (i = 0; i + 1 < length; i++) {
+		EntrySearchAppend(search, query[i]);
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _search_h
+#define _search_h
+#include "main.h"
+
+#define ENTRY_SEARCH_MAX_QUERY 32
+
+/*
+ * A lowercase copy of every entry name, built once, which the selector filters as the
+ * user types. Entries are identified by their position in the list, counting from zero.
+ */
+typedef struct EntrySearch {
+	UINTN count; // Entries in the list, including unnamed ones.
+	LinuxBootOption **options;
+	CHAR8 **names; // NULL for entries without a name.
+	UINTN *lengths;
+	UINTN *matches; // Positions of the entries that match the query, in list order.
+	UINTN match_count;
+	CHAR8 query[ENTRY_SEARCH_MAX_QUERY + 1];
+	UINTN query_length;
+} EntrySearch;
+
+EntrySearch* BuildEntrySearch(BootableLinuxDistro *);
+BOOLEAN EntrySearchAppend(EntrySearch *, CHAR16);
+VOID EntrySearchBackspace(EntrySearch *);
+VOID EntrySearchReset(EntrySearch *);
+
+#endif
@@ -43,18 +43,23 @@ EFI_STATUS efi_delete_variable(const EFI_GUID * const vendor, CHAR16 *name) {
 	return uefi_call_wrapper(RT->SetVariable, 5, name, (EFI_GUID *)vendor, flags, size, NULL);
 }
 
-EFI_STATUS efi_get_variable(const EFI_GUID *const vendor, CHAR16 *name, CHAR8 **buffer, UINTN *size) {
+EFI_STATUS efi_get_variable(const EFI_GUID *const vendor, CHAR16 *name, CHAR8 **buffer, UINTN *size, UINT32 *attributes) {
 	CHAR8 *buf;
-	UINTN length;
+	UINTN length = 0;
 	EFI_STATUS err;
 
-	length = sizeof(CHAR16 *) * EFI_MAXIMUM_VARIABLE_SIZE;
+	// Ask for the size first, so that the buffer is exactly as large as it needs to be.
+	err = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, NULL, &length, NULL);
+	if (err != EFI_BUFFER_TOO_SMALL) {
+		return EFI_ERROR(err) ? err : EFI_NOT_FOUND;
+	}
+
 	buf = AllocatePool(length);
 	if (!buf) {
 		return EFI_OUT_OF_RESOURCES;
 	}
 
-	err = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, NULL, &length, buf);
+	err = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, attributes, &length, buf);
 	if (!EFI_ERROR(err)) {
 		*buffer = buf;
 		if (size) {
@@ -83,51 +88,43 @@ VOID DisplayErrorText(CHAR16 *string) {
 }
 
 #ifdef __APPLE__
-	#pragma mark - Text input functions
+	#pragma mark - Character conversion functions missing from GNU-EFI
 #endif
-EFI_STATUS ReadStringFromKeyboard(OUT CHAR16 **outString) {
-	/* We allocate the memory in this function; it should not be allocated prior to being
-	 * called. */
-	EFI_STATUS err = EFI_SUCCESS;
-	const UINT32 maxInputLength = 1024;
-	UINT32 charactersEntered = 0;
-	*outString = AllocateZeroPool(sizeof(CHAR16) * (maxInputLength + 1));
-	
-	// Check to make sure we have the memory.
-	if (!outString) {
-		DisplayErrorText(L"Error: can't allocate memory for keyboard input.\n");
-		return EFI_OUT_OF_RESOURCES;
-	}
-	
-	// Read (and echo back to) the keyboard
-	CHAR16 key = 0;
-	while (key != 13) {
-		EFI_INPUT_KEY inputKey;
-		err = uefi_call_wrapper(ST->ConIn->ReadKeyStroke, 2, ST->ConIn, &inputKey);
-		if (err != EFI_NOT_READY) {
-			key = inputKey.UnicodeChar;
-			
-			if (!(key < 0x20 || key > 127)) {
-				CHAR16 tempStr[2] = {key, '\0'};
-				StrCat(*outString, tempStr);
-				charactersEntered++;
-				
-				Print(L"%s", tempStr);
-			}
-		}
-		
-		// The user can't overflow the input buffer.
-		if (charactersEntered == maxInputLength) break;
-	}
-	
-	if (StrLen(*outString) > 0) StrCat(*outString, L" ");
-	Print(L"\n");
-	return err;
-}
+/*
+ * The string scans and conversions below look at a machine word at a time where they
+ * can, and fall back to a byte at a time for the ends of strings and for anything that
+ * is not ASCII. HAS_ZERO_BYTE is nonzero if any byte of a word is zero, and
+ * HAS_ZERO_CHAR16 the same for 16-bit characters.
+ */
+typedef UINTN __attribute__((__may_alias__)) Word;
+typedef UINTN __attribute__((__may_alias__, __aligned__(1))) UnalignedWord;
+#if __SIZEOF_POINTER__ == 8
+typedef UINT32 HalfWord;
+#else
+typedef UINT16 HalfWord;
+#endif
+typedef HalfWord __attribute__((__may_alias__, __aligned__(1))) UnalignedHalfWord;
 
-#ifdef __APPLE__
-	#pragma mark - Character conversion functions missing from GNU-EFI
+#define BYTE_LANES (~(UINTN)0 / 0xff)
+#define BYTE_HIGH_BITS (BYTE_LANES * 0x80)
+#define CHAR16_LANES (~(UINTN)0 / 0xffff)
+#define CHAR16_HIGH_BYTES (CHAR16_LANES * 0xff00)
+#define WORD_LANES (~(UINTN)0 / 0xffffffff)
+#define HALF_WORD_MASK ((UINTN)(HalfWord)~0)
+#define CHARS_PER_WORD (sizeof(UINTN) / sizeof(CHAR16))
+
+#define HAS_ZERO_BYTE(w) (((w) - BYTE_LANES) & ~(w) & BYTE_HIGH_BITS)
+#define HAS_ZERO_CHAR16(w) (((w) - CHAR16_LANES) & ~(w) & (CHAR16_LANES * 0x8000))
+#define WORD_ALIGNED(p) (((UINTN)(p) & (sizeof(UINTN) - 1)) == 0)
+
+/* Spreads the bytes in the low half of a word out into the 16-bit lanes of a whole word. */
+static inline UINTN WidenHalfWord(UINTN half) {
+#if __SIZEOF_POINTER__ == 8
+	half = (half | (half << 16)) & (WORD_LANES * 0xffff);
 #endif
+	return (half | (half << 8)) & (CHAR16_LANES * 0xff);
+}
+
 CHAR8* strcpya(CHAR8 *target, const CHAR8 * source) {
 	while ((*target++ = *source++));
 	return target;
@@ -161,7 +158,24 @@ CHAR8* strcata(CHAR8 *dest, const CHAR8 * src) {
 }
 
 CHAR8* strchra(const CHAR8 * s, int c) {
-	while (*s != (char)c) {
+	const UINTN pattern = BYTE_LANES * (UINT8)c;
+	
+	// Go a byte at a time up to a word boundary, so that no word read crosses the end of
+	// the page the string ends in, and then a word at a time until the word with the match
+	// or the terminator in it.
+	for (; !WORD_ALIGNED(s); s++) {
+		if (*s == (CHAR8)c) return (CHAR8 *)s;
+		if (!*s) return NULL;
+	}
+	
+	for (;; s += sizeof(UINTN)) {
+		UINTN word = *(const Word *)s;
+		if (HAS_ZERO_BYTE(word) || HAS_ZERO_BYTE(word ^ pattern)) {
+			break;
+		}
+	}
+	
+	while (*s != (CHAR8)c) {
 		if (!*s++) {
 			return NULL;
 		}
@@ -175,25 +189,68 @@ INTN strposa(const CHAR8 * const str, char c) {
 	return p ? p - str : -1;
 }
 
+/*
+ * Narrows up to InLength characters, stopping at the terminator. Characters outside of
+ * Latin-1 lose their high byte.
+ */
 CHAR8* UTF16toASCII(CHAR16 *InString, UINTN InLength) {
-	CHAR8 *OutString, *InAs8;
+	CHAR8 *OutString;
 	UINTN i = 0;
 	
 	OutString = AllocateZeroPool(InLength * sizeof(CHAR8));
-	InAs8 = (CHAR8*)InString;
-	while ((InAs8[i * 2] != '\0') && (i < InLength)) {
-		OutString[i] = InAs8[i * 2];
-		i++;
+	if (!OutString) {
+		return NULL;
+	}
+	
+	// Whole words of characters that have no high byte and no terminator in them are
+	// narrowed at once by packing their low bytes together.
+	for (; i + CHARS_PER_WORD <= InLength; i += CHARS_PER_WORD) {
+		UINTN word = *(const UnalignedWord *)(InString + i);
+		if ((word & CHAR16_HIGH_BYTES) || HAS_ZERO_CHAR16(word)) {
+			break;
+		}
+		
+		word = (word | (word >> 8)) & (WORD_LANES * 0xffff);
+#if __SIZEOF_POINTER__ == 8
+		word = (word | (word >> 16)) & 0xffffffff;
+#endif
+		*(UnalignedHalfWord *)(OutString + i) = (HalfWord)word;
+	}
+	
+	for (; i < InLength && InString[i] != '\0'; i++) {
+		OutString[i] = (CHAR8)InString[i];
 	}
 	return OutString;
 }
 
+/* Widens InLength bytes of UTF-8, which do not need to be terminated. */
 CHAR16* ASCIItoUTF16(CHAR8 *InString, UINTN InLength) {
 	UINTN strlen = 0, i = 0;
 	CHAR16 *str;
 
 	str = AllocatePool((InLength + 1) * sizeof(CHAR16));
+	if (!str) {
+		return NULL;
+	}
+	
 	while (i < InLength) {
+		// Plain ASCII, which is nearly everything, is widened a word at a time by
+		// spreading the bytes out into 16-bit lanes.
+		for (; i + sizeof(UINTN) <= InLength; i += sizeof(UINTN), strlen += sizeof(UINTN)) {
+			UINTN word = *(const UnalignedWord *)(InString + i);
+			if (word & BYTE_HIGH_BITS) {
+				break;
+			}
+			
+			UINTN low = word & HALF_WORD_MASK, high = word >> (sizeof(UINTN) * 4);
+			*(UnalignedWord *)(str + strlen) = WidenHalfWord(low);
+			*(UnalignedWord *)(str + strlen + CHARS_PER_WORD) = WidenHalfWord(high);
+		}
+		
+		if (i >= InLength) {
+			break;
+		}
+		
 		INTN utf8len = NarrowToLongCharConvert(InString + i, str + strlen);
 		if (utf8len <= 0) {
 			i++;
@@ -262,6 +319,21 @@ INTN NarrowToLongCharConvert(CHAR8 *InString, CHAR16 *c) {
 	return len;
 }
 
+/*
+ * Hashes a block of memory with 64-bit FNV-1a. Start with HASH_INITIAL_VALUE, or with the
+ * result of a previous call to hash several blocks as one.
+ */
+UINT64 HashBytes(const VOID *data, UINTN length, UINT64 hash) {
+	const UINT8 *bytes = data;
+	
+	while (length--) {
+		hash ^= *bytes++;
+		hash *= 0x100000001b3ULL;
+	}
+	
+	return hash;
+}
+
 /**
  * Converts between different path formats. This is a very rudimentary search and does not work
  * correctly if there is more than one type of path separator in a string.
@@ -277,19 +349,328 @@ CHAR8* PathConvert(CHAR8 needle, CHAR8 *path) {
 	return path;
 }
 
-BOOLEAN FileExists(EFI_FILE_HANDLE dir, CHAR16 *name) {
+#ifdef __APPLE__
+	#pragma mark - Directory handle and file metadata cache
+#endif
+/*
+ * Firmware file systems resolve every path from the root of the volume, which over USB
+ * means walking the FAT again for each lookup. We keep the directories we've looked in
+ * open, and remember what we've learned about the files in them (including that they
+ * don't exist), so repeated lookups become relative opens or plain cache hits.
+ *
+ * Files are also looked up from timer events while the menu is shown, so the cache is
+ * only ever touched at TPL_CALLBACK.
+ */
+#define FILE_CACHE_DIRECTORIES 8
+#define FILE_CACHE_FILES 32
+
+typedef struct {
+	EFI_FILE_HANDLE root;
+	CHAR16 *path;
 	EFI_FILE_HANDLE handle;
-	EFI_STATUS err;
+} CachedDirectory;
+
+typedef struct {
+	EFI_FILE_HANDLE root;
+	CHAR16 *path;
+	EFI_FILE_INFO *info; // NULL if the file doesn't exist.
+} CachedFileInfo;
+
+static CachedDirectory cached_directories[FILE_CACHE_DIRECTORIES];
+static CachedFileInfo cached_files[FILE_CACHE_FILES];
+static UINTN next_directory_slot = 0, next_file_slot = 0;
 
-	err = uefi_call_wrapper(dir->Open, 5, dir, &handle, name, EFI_FILE_MODE_READ, NULL);
+/*
+ * Splits a path into the directory part and the file name. The directory is returned
+ * as a newly allocated string, or NULL if the file is at the top of the path.
+ */
+static CHAR16* SplitPath(const CHAR16 * const path, OUT const CHAR16 **leaf) {
+	const CHAR16 *separator = NULL, *p;
+	CHAR16 *directory;
+	UINTN length;
+	
+	for (p = path; *p; p++) {
+		if (*p == '\\') {
+			separator = p;
+		}
+	}
+	
+	if (!separator) {
+		*leaf = path;
+		return NULL;
+	}
+	
+	*leaf = separator + 1;
+	length = separator - path;
+	if (length == 0) {
+		// The file is in the root directory; there's nothing worth caching.
+		return NULL;
+	}
+	
+	directory = AllocatePool((length + 1) * sizeof(CHAR16));
+	if (!directory) {
+		// Let the firmware resolve the whole path instead.
+		*leaf = path;
+		return NULL;
+	}
+	CopyMem(directory, (VOID *)path, length * sizeof(CHAR16));
+	directory[length] = '\0';
+	return directory;
+}
+
+/*
+ * Returns an open handle to the given directory, opening and caching it if it hasn't
+ * been used before. The handle is owned by the cache and must not be closed.
+ */
+static EFI_FILE_HANDLE FileCacheOpenDirectoryLocked(EFI_FILE_HANDLE root, CHAR16 *path) {
+	CachedDirectory *slot;
+	EFI_FILE_HANDLE handle;
+	EFI_STATUS err;
+	UINTN i;
+	
+	for (i = 0; i < FILE_CACHE_DIRECTORIES; i++) {
+		slot = &cached_directories[i];
+		if (slot->root == root && slot->path && StriCmp(slot->path, path) == 0) {
+			return slot->handle;
+		}
+	}
+	
+	err = uefi_call_wrapper(root->Open, 5, root, &handle, path, EFI_FILE_MODE_READ, 0);
 	if (EFI_ERROR(err)) {
-		goto out;
+		return NULL;
+	}
+	
+	// Replace the oldest entry if we're out of room.
+	slot = &cached_directories[next_directory_slot];
+	next_directory_slot = (next_directory_slot + 1) % FILE_CACHE_DIRECTORIES;
+	if (slot->path) {
+		uefi_call_wrapper(slot->handle->Close, 1, slot->handle);
+		FreePool(slot->path);
+	}
+	
+	slot->root = root;
+	slot->path = StrDuplicate(path);
+	slot->handle = handle;
+	if (!slot->path) {
+		uefi_call_wrapper(handle->Close, 1, handle);
+		slot->root = NULL;
+		return NULL;
 	}
+	
+	return handle;
+}
 
-	uefi_call_wrapper(handle->Close, 1, handle);
-	return TRUE;
-out:
-	return FALSE;
+/*
+ * Opens a file for reading. The file's directory is opened through the cache, so only
+ * the last path component has to be looked up by the firmware.
+ */
+EFI_STATUS FileCacheOpen(EFI_FILE_HANDLE root, const CHAR16 * const path, OUT EFI_FILE_HANDLE *handle) {
+	EFI_TPL old_tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	const CHAR16 *leaf;
+	CHAR16 *directory = SplitPath(path, &leaf);
+	EFI_FILE_HANDLE dir = root;
+	EFI_STATUS err = EFI_NOT_FOUND;
+	
+	// The directory handle must not be evicted before we're done with it.
+	if (directory) {
+		dir = FileCacheOpenDirectoryLocked(root, directory);
+		FreePool(directory);
+	}
+	
+	if (dir) {
+		err = uefi_call_wrapper(dir->Open, 5, dir, handle, (CHAR16 *)leaf, EFI_FILE_MODE_READ, 0);
+	}
+	
+	uefi_call_wrapper(BS->RestoreTPL, 1, old_tpl);
+	return err;
+}
+
+static CachedFileInfo* FileCacheLookup(EFI_FILE_HANDLE root, const CHAR16 * const path) {
+	UINTN i;
+	
+	for (i = 0; i < FILE_CACHE_FILES; i++) {
+		if (cached_files[i].root == root && cached_files[i].path &&
+			StriCmp(cached_files[i].path, (CHAR16 *)path) == 0) {
+			return &cached_files[i];
+		}
+	}
+	
+	return NULL;
+}
+
+/* Records what we know about a file. The cache takes ownership of info, which may be NULL. */
+static VOID FileCacheStore(EFI_FILE_HANDLE root, const CHAR16 * const path, EFI_FILE_INFO *info) {
+	CachedFileInfo *slot = FileCacheLookup(root, path);
+	
+	if (!slot) {
+		slot = &cached_files[next_file_slot];
+		next_file_slot = (next_file_slot + 1) % FILE_CACHE_FILES;
+		if (slot->path) {
+			FreePool(slot->path);
+		}
+		
+		slot->root = root;
+		slot->path = StrDuplicate((CHAR16 *)path);
+		if (!slot->path) {
+			slot->root = NULL;
+			if (info) {
+				FreePool(info);
+			}
+			return;
+		}
+	}
+	
+	if (slot->info) {
+		FreePool(slot->info);
+	}
+	slot->info = info;
+}
+
+/*
+ * Copies the metadata of a file, without its name, into info, which may be NULL to only
+ * check that the file exists. Returns EFI_NOT_FOUND if it doesn't. The cached copy is
+ * only ever touched at TPL_CALLBACK, since the background validation may evict it.
+ */
+EFI_STATUS FileCacheGetInfo(EFI_FILE_HANDLE root, const CHAR16 * const path, OUT EFI_FILE_INFO *info) {
+	EFI_TPL old_tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	CachedFileInfo *cached = FileCacheLookup(root, path);
+	EFI_FILE_HANDLE handle;
+	EFI_FILE_INFO *found = NULL;
+	
+	if (cached) {
+		found = cached->info;
+	} else if (!EFI_ERROR(FileCacheOpen(root, path, &handle))) {
+		found = LibFileInfo(handle);
+		uefi_call_wrapper(handle->Close, 1, handle);
+	}
+	
+	if (found && info) {
+		CopyMem(info, found, SIZE_OF_EFI_FILE_INFO);
+	}
+	if (!cached) {
+		FileCacheStore(root, path, found);
+	}
+	
+	uefi_call_wrapper(BS->RestoreTPL, 1, old_tpl);
+	return found ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+/* Forgets anything cached about the given file, e.g. after it was written to. */
+VOID FileCacheInvalidate(EFI_FILE_HANDLE root, const CHAR16 * const path) {
+	EFI_TPL old_tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	CachedFileInfo *cached = FileCacheLookup(root, path);
+	
+	if (cached) {
+		if (cached->info) {
+			FreePool(cached->info);
+		}
+		FreePool(cached->path);
+		cached->path = NULL;
+		cached->info = NULL;
+		cached->root = NULL;
+	}
+	
+	uefi_call_wrapper(BS->RestoreTPL, 1, old_tpl);
+}
+
+/* Returns TRUE if path is the given directory or lies below it, ignoring case like FAT does. */
+static BOOLEAN PathIsWithin(const CHAR16 *path, const CHAR16 *directory) {
+	for (; *directory; path++, directory++) {
+		CHAR16 a = *path >= 'A' && *path <= 'Z' ? *path + ('a' - 'A') : *path;
+		CHAR16 b = *directory >= 'A' && *directory <= 'Z' ? *directory + ('a' - 'A') : *directory;
+		if (a != b) {
+			return FALSE;
+		}
+	}
+	
+	return *path == '\0' || *path == '\\';
+}
+
+/*
+ * Closes the cached handles of a directory and the directories below it, and forgets
+ * what is known about the files in them. Needed before the directory is removed.
+ */
+VOID FileCacheInvalidateDirectory(EFI_FILE_HANDLE root, const CHAR16 * const path) {
+	EFI_TPL old_tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	UINTN i;
+	
+	for (i = 0; i < FILE_CACHE_DIRECTORIES; i++) {
+		CachedDirectory *slot = &cached_directories[i];
+		if (slot->root == root && slot->path && PathIsWithin(slot->path, path)) {
+			uefi_call_wrapper(slot->handle->Close, 1, slot->handle);
+			FreePool(slot->path);
+			slot->path = NULL;
+			slot->handle = NULL;
+			slot->root = NULL;
+		}
+	}
+	
+	for (i = 0; i < FILE_CACHE_FILES; i++) {
+		CachedFileInfo *cached = &cached_files[i];
+		if (cached->root == root && cached->path && PathIsWithin(cached->path, path)) {
+			if (cached->info) {
+				FreePool(cached->info);
+			}
+			FreePool(cached->path);
+			cached->path = NULL;
+			cached->info = NULL;
+			cached->root = NULL;
+		}
+	}
+	
+	uefi_call_wrapper(BS->RestoreTPL, 1, old_tpl);
+}
+
+/* Closes every cached directory handle and forgets all file metadata. */
+VOID FileCacheFlush(VOID) {
+	EFI_TPL old_tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	UINTN i;
+	
+	for (i = 0; i < FILE_CACHE_DIRECTORIES; i++) {
+		if (cached_directories[i].path) {
+			uefi_call_wrapper(cached_directories[i].handle->Close, 1, cached_directories[i].handle);
+			FreePool(cached_directories[i].path);
+		}
+	}
+	
+	for (i = 0; i < FILE_CACHE_FILES; i++) {
+		if (cached_files[i].path) {
+			if (cached_files[i].info) {
+				FreePool(cached_files[i].info);
+			}
+			FreePool(cached_files[i].path);
+		}
+	}
+	
+	SetMem(cached_directories, sizeof(cached_directories), 0);
+	SetMem(cached_files, sizeof(cached_files), 0);
+	next_directory_slot = next_file_slot = 0;
+	uefi_call_wrapper(BS->RestoreTPL, 1, old_tpl);
+}
+
+/*
+ * Converts a path written for GRUB, with forward slashes, into a path the firmware's
+ * file system understands. The result must be freed by the caller.
+ */
+CHAR16* GRUBPathToEFIPath(CHAR8 *path) {
+	CHAR16 *result = ASCIItoUTF16(path, strlena(path));
+	UINTN i;
+	
+	if (!result) {
+		return NULL;
+	}
+	
+	for (i = 0; result[i]; i++) {
+		if (result[i] == '/') {
+			result[i] = '\\';
+		}
+	}
+	
+	return result;
+}
+
+BOOLEAN FileExists(EFI_FILE_HANDLE dir, CHAR16 *name) {
+	return !EFI_ERROR(FileCacheGetInfo(dir, name, NULL));
 }
 
 #ifdef __APPLE__
@@ -297,20 +678,27 @@ out:
 #endif
 UINTN FileRead(EFI_FILE_HANDLE dir, const CHAR16 * const name, CHAR8 **content) {
 	EFI_FILE_HANDLE handle;
-	EFI_FILE_INFO *info;
+	EFI_FILE_INFO info;
 	CHAR8 *buf;
 	UINTN buflen;
 	EFI_STATUS err;
 	UINTN len = 0;
 	
-	err = uefi_call_wrapper(dir->Open, 5, dir, &handle, name, EFI_FILE_MODE_READ, NULL);
+	err = FileCacheOpen(dir, name, &handle);
 	if (EFI_ERROR(err)) {
 		goto out;
 	}
 	
-	info = LibFileInfo(handle);
-	buflen = info->FileSize+1;
-	buf = AllocatePool(buflen);
+	buflen = 0;
+	buf = NULL;
+	if (!EFI_ERROR(FileCacheGetInfo(dir, name, &info))) {
+		buflen = info.FileSize;
+		buf = AllocatePool(buflen + 1);
+	}
+	if (!buf) {
+		uefi_call_wrapper(handle->Close, 1, handle);
+		goto out;
+	}
 	
 	err = uefi_call_wrapper(handle->Read, 3, handle, &buflen, buf);
 	if (EFI_ERROR(err) == EFI_SUCCESS) {
@@ -321,12 +709,391 @@ UINTN FileRead(EFI_FILE_HANDLE dir, const CHAR16 * const name, CHAR8 **content)
 		FreePool(buf);
 	}
 	
-	FreePool(info);
 	uefi_call_wrapper(handle->Close, 1, handle);
 out:
 	return len;
 }
 
+#ifdef __APPLE__
+	#pragma mark - Streaming file reader
+#endif
+/*
+ * Revision 2 of the file protocol adds asynchronous reads which complete by signalling
+ * an event. GNU-EFI doesn't describe the extended protocol, so define it here.
+ */
+#define ASYNC_FILE_REVISION 0x00020000
+
+typedef struct {
+	EFI_EVENT Event;
+	EFI_STATUS Status;
+	UINTN BufferSize;
+	VOID *Buffer;
+} ASYNC_FILE_IO_TOKEN;
+
+typedef struct {
+	EFI_FILE File;
+	EFI_STATUS (EFIAPI *OpenEx)(EFI_FILE_HANDLE, EFI_FILE_HANDLE *, CHAR16 *, UINT64, UINT64, ASYNC_FILE_IO_TOKEN *);
+	EFI_STATUS (EFIAPI *ReadEx)(EFI_FILE_HANDLE, ASYNC_FILE_IO_TOKEN *);
+	EFI_STATUS (EFIAPI *WriteEx)(EFI_FILE_HANDLE, ASYNC_FILE_IO_TOKEN *);
+	EFI_STATUS (EFIAPI *FlushEx)(EFI_FILE_HANDLE, ASYNC_FILE_IO_TOKEN *);
+} ASYNC_FILE;
+
+struct FileStream {
+	EFI_FILE_HANDLE handle;
+	UINT64 file_size;
+	UINT64 requested; // Bytes requested from the firmware so far, less what reads came short by.
+	UINT64 delivered; // Bytes handed to the consumer so far.
+	UINTN chunk_size;
+	
+	EFI_PHYSICAL_ADDRESS pages;
+	UINTN page_count;
+	CHAR8 *buffers[2];
+	UINTN lengths[2];
+	BOOLEAN pending[2];
+	ASYNC_FILE_IO_TOKEN tokens[2];
+	UINTN current;
+	BOOLEAN async;
+};
+
+/*
+ * Returns the buffer alignment required by the block device backing a volume. Page
+ * allocations already satisfy anything up to EFI_PAGE_SIZE.
+ */
+static UINTN DeviceIoAlignment(EFI_HANDLE device) {
+	EFI_BLOCK_IO *block_io = NULL;
+	EFI_STATUS err;
+	
+	if (!device) {
+		return 1;
+	}
+	
+	err = uefi_call_wrapper(BS->HandleProtocol, 3, device, &BlockIoProtocol, (VOID **)&block_io);
+	if (EFI_ERROR(err) || !block_io || !block_io->Media || block_io->Media->IoAlign <= 1) {
+		return 1;
+	}
+	
+	return block_io->Media->IoAlign;
+}
+
+/*
+ * Starts reading the next chunk of the file into the given buffer. On firmware without
+ * asynchronous reads the chunk is read before this function returns.
+ */
+static EFI_STATUS FileStreamIssueRead(FileStream *stream, UINTN index) {
+	EFI_STATUS err;
+	UINT64 remaining = stream->file_size - stream->requested;
+	UINTN length = remaining < stream->chunk_size ? (UINTN)remaining : stream->chunk_size;
+	
+	stream->lengths[index] = length;
+	if (length == 0) {
+		return EFI_SUCCESS;
+	}
+	
+	if (stream->async) {
+		ASYNC_FILE_IO_TOKEN *token = &stream->tokens[index];
+		token->Status = EFI_SUCCESS;
+		token->BufferSize = length;
+		token->Buffer = stream->buffers[index];
+		
+		err = uefi_call_wrapper(((ASYNC_FILE *)stream->handle)->ReadEx, 2, stream->handle, token);
+		if (!EFI_ERROR(err)) {
+			stream->pending[index] = TRUE;
+			stream->requested += length;
+			return EFI_SUCCESS;
+		}
+		
+		// Some firmware advertises revision 2 but doesn't implement it; stop trying.
+		stream->async = FALSE;
+	}
+	
+	err = uefi_call_wrapper(stream->handle->Read, 3, stream->handle, &length, stream->buffers[index]);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	if (length == 0) {
+		// The file is shorter than it was when it was opened.
+		stream->lengths[index] = 0;
+		return EFI_VOLUME_CORRUPTED;
+	}
+	
+	stream->lengths[index] = length;
+	stream->requested += length;
+	return EFI_SUCCESS;
+}
+
+/*
+ * Waits for an outstanding asynchronous read into the given buffer to finish. A read may
+ * deliver less than it asked for; the rest is asked for again by the next read.
+ */
+static EFI_STATUS FileStreamWait(FileStream *stream, UINTN index) {
+	ASYNC_FILE_IO_TOKEN *token = &stream->tokens[index];
+	UINTN event_index, length;
+	
+	if (!stream->pending[index]) {
+		return EFI_SUCCESS;
+	}
+	
+	uefi_call_wrapper(BS->WaitForEvent, 3, 1, &token->Event, &event_index);
+	stream->pending[index] = FALSE;
+	
+	length = EFI_ERROR(token->Status) ? 0 : token->BufferSize;
+	if (length > stream->lengths[index]) {
+		length = stream->lengths[index];
+	}
+	stream->requested -= stream->lengths[index] - length;
+	stream->lengths[index] = length;
+	
+	if (EFI_ERROR(token->Status)) {
+		return token->Status;
+	}
+	return length == 0 ? EFI_VOLUME_CORRUPTED : EFI_SUCCESS;
+}
+
+/*
+ * Opens a file for chunked reading. The device is the handle of the volume containing
+ * dir; it is used to align the buffers as the underlying block device requires, and may
+ * be NULL. A chunk_size of zero selects FILE_STREAM_DEFAULT_CHUNK_SIZE.
+ */
+EFI_STATUS FileStreamOpen(EFI_FILE_HANDLE dir, const CHAR16 * const name, EFI_HANDLE device,
+	UINTN chunk_size, OUT FileStream **out) {
+	FileStream *stream;
+	EFI_FILE_INFO info;
+	EFI_STATUS err;
+	UINTN alignment, buffer_size, i;
+	
+	*out = NULL;
+	stream = AllocateZeroPool(sizeof(FileStream));
+	if (!stream) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	
+	err = FileCacheOpen(dir, name, &stream->handle);
+	if (EFI_ERROR(err)) {
+		FreePool(stream);
+		return err;
+	}
+	
+	if (EFI_ERROR(FileCacheGetInfo(dir, name, &info))) {
+		FileStreamClose(stream);
+		return EFI_DEVICE_ERROR;
+	}
+	stream->file_size = info.FileSize;
+	
+	// Round the chunk size up to a whole number of pages and add slack for devices that
+	// need more than page alignment.
+	alignment = DeviceIoAlignment(device);
+	stream->chunk_size = EFI_SIZE_TO_PAGES(chunk_size ? chunk_size : FILE_STREAM_DEFAULT_CHUNK_SIZE) * EFI_PAGE_SIZE;
+	buffer_size = stream->chunk_size;
+	if (alignment > EFI_PAGE_SIZE) {
+		buffer_size = (buffer_size + alignment - 1) & ~(alignment - 1);
+	}
+	stream->page_count = EFI_SIZE_TO_PAGES(buffer_size * 2 + (alignment > EFI_PAGE_SIZE ? alignment : 0));
+	
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, stream->page_count, &stream->pages);
+	if (EFI_ERROR(err)) {
+		stream->page_count = 0;
+		FileStreamClose(stream);
+		return err;
+	}
+	
+	stream->buffers[0] = (CHAR8 *)(UINTN)((stream->pages + alignment - 1) & ~((EFI_PHYSICAL_ADDRESS)alignment - 1));
+	stream->buffers[1] = stream->buffers[0] + buffer_size;
+	
+	// Use asynchronous reads if the firmware's file protocol supports them.
+	if (stream->handle->Revision >= ASYNC_FILE_REVISION) {
+		stream->async = TRUE;
+		for (i = 0; i < 2 && stream->async; i++) {
+			err = uefi_call_wrapper(BS->CreateEvent, 5, 0, 0, NULL, NULL, &stream->tokens[i].Event);
+			if (EFI_ERROR(err)) {
+				stream->async = FALSE;
+			}
+		}
+	}
+	
+	*out = stream;
+	return EFI_SUCCESS;
+}
+
+/*
+ * Starts reading the first chunk without waiting for it, so that reads of several files
+ * can be in flight at the same time. Calling this is optional.
+ */
+EFI_STATUS FileStreamStart(FileStream *stream) {
+	if (stream->requested != 0 || stream->delivered != 0) {
+		return EFI_SUCCESS;
+	}
+	
+	return FileStreamIssueRead(stream, stream->current);
+}
+
+/*
+ * Returns the next chunk of the file. The chunk stays valid until the next call; at the
+ * end of the file, length is set to zero. Before returning, the read of the following
+ * chunk is started so that it overlaps whatever the caller does with this one.
+ */
+EFI_STATUS FileStreamNextChunk(FileStream *stream, OUT CHAR8 **chunk, OUT UINTN *length) {
+	EFI_STATUS err;
+	UINTN index = stream->current;
+	
+	*chunk = NULL;
+	*length = 0;
+	
+	// Nothing may have been requested yet for the very first chunk.
+	err = FileStreamStart(stream);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	err = FileStreamWait(stream, index);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	if (stream->lengths[index] == 0) {
+		return EFI_SUCCESS;
+	}
+	
+	// Read ahead into the other buffer, which the caller is done with by now.
+	err = FileStreamIssueRead(stream, index ^ 1);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	*chunk = stream->buffers[index];
+	*length = stream->lengths[index];
+	stream->delivered += *length;
+	stream->current = index ^ 1;
+	return EFI_SUCCESS;
+}
+
+/* Hands the whole file to the consumer, one chunk at a time. */
+EFI_STATUS FileStreamRead(FileStream *stream, FileStreamConsumer consumer, VOID *context) {
+	EFI_STATUS err;
+	CHAR8 *chunk;
+	UINTN length;
+	
+	for (;;) {
+		UINT64 offset = stream->delivered;
+		
+		err = FileStreamNextChunk(stream, &chunk, &length);
+		if (EFI_ERROR(err) || length == 0) {
+			return err;
+		}
+		
+		err = consumer(chunk, length, offset, context);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+	}
+}
+
+/*
+ * Reads the next length bytes of the file into their final destination. Chunks that were
+ * already read ahead, e.g. by FileStreamStart, are copied out of the stream's buffers;
+ * everything after them is read straight into the destination. Returns EFI_END_OF_FILE
+ * if the file ends first. FileStreamNextChunk can't be used on the stream afterwards.
+ */
+EFI_STATUS FileStreamReadInto(FileStream *stream, VOID *destination, UINTN length) {
+	EFI_STATUS err;
+	CHAR8 *dest = destination;
+	
+	while (length > 0 && stream->requested != stream->delivered) {
+		UINTN index = stream->current, available;
+		
+		err = FileStreamWait(stream, index);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+		
+		// The rest of a chunk that is only partly needed stays in front of its buffer.
+		available = stream->lengths[index];
+		if (available > length) {
+			CopyMem(dest, stream->buffers[index], length);
+			CopyMem(stream->buffers[index], stream->buffers[index] + length, available - length);
+			stream->lengths[index] -= length;
+			stream->delivered += length;
+			return EFI_SUCCESS;
+		}
+		
+		CopyMem(dest, stream->buffers[index], available);
+		dest += available;
+		length -= available;
+		stream->delivered += available;
+		stream->lengths[index] = 0;
+		stream->current = index ^ 1;
+	}
+	
+	while (length > 0 && stream->requested < stream->file_size) {
+		UINTN read_size = length < stream->chunk_size ? length : stream->chunk_size;
+		
+		err = uefi_call_wrapper(stream->handle->Read, 3, stream->handle, &read_size, dest);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+		if (read_size == 0) {
+			break;
+		}
+		
+		dest += read_size;
+		length -= read_size;
+		stream->requested += read_size;
+		stream->delivered += read_size;
+	}
+	
+	return length > 0 ? EFI_END_OF_FILE : EFI_SUCCESS;
+}
+
+UINT64 FileStreamSize(FileStream *stream) {
+	return stream->file_size;
+}
+
+VOID FileStreamClose(FileStream *stream) {
+	UINTN i;
+	
+	if (!stream) {
+		return;
+	}
+	
+	for (i = 0; i < 2; i++) {
+		// The firmware still owns a buffer with a read in flight.
+		FileStreamWait(stream, i);
+		if (stream->tokens[i].Event) {
+			uefi_call_wrapper(BS->CloseEvent, 1, stream->tokens[i].Event);
+		}
+	}
+	
+	if (stream->page_count) {
+		uefi_call_wrapper(BS->FreePages, 2, stream->pages, stream->page_count);
+	}
+	if (stream->handle) {
+		uefi_call_wrapper(stream->handle->Close, 1, stream->handle);
+	}
+	FreePool(stream);
+}
+
+/* Returns the length of the line at the start of the given string, a word at a time. */
+static UINTN LineLength(const CHAR8 *line) {
+	const CHAR8 *end = line;
+	
+	for (; !WORD_ALIGNED(end); end++) {
+		if (*end == '\0' || *end == '\n' || *end == '\r') {
+			return end - line;
+		}
+	}
+	
+	for (;; end += sizeof(UINTN)) {
+		UINTN word = *(const Word *)end;
+		if (HAS_ZERO_BYTE(word) || HAS_ZERO_BYTE(word ^ (BYTE_LANES * '\n')) || HAS_ZERO_BYTE(word ^ (BYTE_LANES * '\r'))) {
+			break;
+		}
+	}
+	
+	for (; *end && *end != '\n' && *end != '\r'; end++);
+	return end - line;
+}
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t')
+
 // This code has been adapted from gummiboot. Thanks, guys!
 CHAR8* GetConfigurationKeyAndValue(CHAR8 *content, UINTN *pos, CHAR8 **key_ret, CHAR8 **value_ret) {
 	CHAR8 *line;
@@ -339,10 +1106,7 @@ skip:
 		return NULL;
 	}
 
-	linelen = 0;
-	while (line[linelen] && !strchra((CHAR8 *)"\n\r", line[linelen])) {
-		linelen++;
-	}
+	linelen = LineLength(line);
 
 	/* Move the position to the next line. */
 	*pos += linelen;
@@ -359,12 +1123,12 @@ skip:
 	line[linelen] = '\0';
 
 	/* Remove leading and trailing whitespace. */
-	while (strchra((CHAR8 *)" \t", *line)) {
+	while (IS_BLANK(*line)) {
 		line++;
 		linelen--;
 	}
 
-	while (linelen > 0 && strchra((CHAR8 *)" \t", line[linelen-1])) {
+	while (linelen > 0 && IS_BLANK(line[linelen-1])) {
 		linelen--;
 	}
 	line[linelen] = '\0';
@@ -375,7 +1139,7 @@ skip:
 
 	/* Split the key and the value. */
 	value = line;
-	while (*value && !strchra((CHAR8 *)" \t", *value)) {
+	while (*value && !IS_BLANK(*value)) {
 		value++;
 	}
 	
@@ -385,7 +1149,7 @@ skip:
 	
 	*value = '\0';
 	value++;
-	while (*value && strchra((CHAR8 *)" \t", *value)) {
+	while (IS_BLANK(*value)) {
 		value++;
 	}
 
@@ -23,7 +23,7 @@
 
 EFI_STATUS efi_set_variable(const EFI_GUID const *, CHAR16 *, CHAR8 *, UINTN, BOOLEAN);
 EFI_STATUS efi_delete_variable(const EFI_GUID const *, CHAR16 *);
-EFI_STATUS efi_get_variable(const EFI_GUID const *, CHAR16 *, CHAR8 **, UINTN *);
+EFI_STATUS efi_get_variable(const EFI_GUID const *, CHAR16 *, CHAR8 **, UINTN *, UINT32 *);
 
 CHAR8* strcpya(CHAR8 *, const CHAR8 *);
 CHAR8* strchra(const CHAR8 *, int);
@@ -33,14 +33,45 @@ INTN strposa(const CHAR8 const *, char);
 
 INTN NarrowToLongCharConvert(CHAR8 *InChar, OUT CHAR16 *);
 CHAR8* PathConvert(CHAR8, CHAR8 *);
+
+#define HASH_INITIAL_VALUE 0xcbf29ce484222325ULL
+UINT64 HashBytes(const VOID *, UINTN, UINT64);
 CHAR16* ASCIItoUTF16(CHAR8 *, UINTN);
 CHAR8* UTF16toASCII(CHAR16 *, UINTN);
 
+EFI_STATUS FileCacheOpen(EFI_FILE_HANDLE, const CHAR16 const *, OUT EFI_FILE_HANDLE *);
+EFI_STATUS FileCacheGetInfo(EFI_FILE_HANDLE, const CHAR16 const *, OUT EFI_FILE_INFO *);
+VOID FileCacheInvalidate(EFI_FILE_HANDLE, const CHAR16 const *);
+VOID FileCacheInvalidateDirectory(EFI_FILE_HANDLE, const CHAR16 const *);
+VOID FileCacheFlush(VOID);
+
+CHAR16* GRUBPathToEFIPath(CHAR8 *);
 BOOLEAN FileExists(EFI_FILE_HANDLE, CHAR16 *);
 UINTN FileRead(EFI_FILE_HANDLE, const CHAR16 const *, CHAR8 **);
+
+/* The default amount of data handed to a stream consumer at once. */
+#define FILE_STREAM_DEFAULT_CHUNK_SIZE (1024 * 1024)
+
+/*
+ * A file being read in fixed-size chunks through two page-allocated buffers. While
+ * the consumer works on one buffer, the next chunk is read into the other one if the
+ * firmware supports asynchronous file I/O.
+ */
+typedef struct FileStream FileStream;
+
+/* Called once for every chunk of a file, in order. Returning an error stops the read. */
+typedef EFI_STATUS (*FileStreamConsumer)(CHAR8 *, UINTN, UINT64, VOID *);
+
+EFI_STATUS FileStreamOpen(EFI_FILE_HANDLE, const CHAR16 const *, EFI_HANDLE, UINTN, OUT FileStream **);
+EFI_STATUS FileStreamStart(FileStream *);
+EFI_STATUS FileStreamNextChunk(FileStream *, OUT CHAR8 **, OUT UINTN *);
+EFI_STATUS FileStreamRead(FileStream *, FileStreamConsumer, VOID *);
+EFI_STATUS FileStreamReadInto(FileStream *, VOID *, UINTN);
+UINT64 FileStreamSize(FileStream *);
+VOID FileStreamClose(FileStream *);
+
 CHAR8* GetConfigurationKeyAndValue(CHAR8 *, UINTN *, CHAR8 **, CHAR8 **);
 VOID DisplayColoredText(CHAR16 *);
 VOID DisplayErrorText(CHAR16 *);
-EFI_STATUS ReadStringFromKeyboard(OUT CHAR16 **);
 
 #endif
@@ -0,0 +1,233 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "validation.h"
+#include "volumes.h"
+
+/*
+ * Nothing on disk is checked while the configuration file is parsed. Instead, a timer
+ * event checks one file per tick while the menu waits for the user, and the menu is
+ * told about the results through validation_event. Anything that is needed before the
+ * checks get to it is validated on the spot.
+ */
+CoreFileState core_files;
+EFI_EVENT validation_event = NULL;
+
+static EFI_EVENT timer_event = NULL;
+static EFI_FILE_HANDLE validation_root = NULL;
+static BootableLinuxDistro *next_entry = NULL;
+static FileStream *grub_stream = NULL;
+
+#define PE_MACHINE_IA32 0x014c
+#define PE_MACHINE_X64 0x8664
+
+/* Returns TRUE if the buffer holds a PE image that this machine can run. */
+static BOOLEAN IsRunnableImage(CHAR8 *image, UINTN size) {
+	UINT32 pe_offset;
+	UINT16 machine;
+	
+	if (size < 0x40 || image[0] != 'M' || image[1] != 'Z') {
+		return FALSE;
+	}
+	
+	CopyMem(&pe_offset, image + 0x3c, sizeof(pe_offset));
+	if (pe_offset > size - 6 || CompareMem(image + pe_offset, "PE\0\0", 4) != 0) {
+		return FALSE;
+	}
+	
+	CopyMem(&machine, image + pe_offset + 4, sizeof(machine));
+#if defined(__x86_64__)
+	return machine == PE_MACHINE_X64;
+#elif defined(__i386__)
+	return machine == PE_MACHINE_IA32;
+#else
+	return TRUE;
+#endif
+}
+
+/*
+ * Starts reading GRUB into memory so that the read overlaps the rest of startup. Once
+ * the user picks an entry, it can be started straight from memory.
+ */
+VOID StartGRUBPreload(EFI_FILE_HANDLE root, EFI_HANDLE device) {
+	if (EFI_ERROR(FileStreamOpen(root, GRUB_IMAGE_PATH, device, 0, &grub_stream))) {
+		grub_stream = NULL;
+		return;
+	}
+	
+	if (EFI_ERROR(FileStreamStart(grub_stream))) {
+		FileStreamClose(grub_stream);
+		grub_stream = NULL;
+	}
+}
+
+/*
+ * Waits for the read started by StartGRUBPreload and checks that what was read is an
+ * image we can start. Everything else learns whether GRUB is usable through core_files.
+ */
+VOID FinishGRUBPreload(VOID) {
+	UINTN size;
+	EFI_STATUS err = EFI_OUT_OF_RESOURCES;
+	
+	if (!grub_stream) {
+		return;
+	}
+	
+	// Only the first chunk went through the stream's buffers; the rest of GRUB is read
+	// straight into its final place.
+	size = (UINTN)FileStreamSize(grub_stream);
+	core_files.grub_image = AllocatePool(size);
+	if (core_files.grub_image) {
+		err = FileStreamReadInto(grub_stream, core_files.grub_image, size);
+	}
+	FileStreamClose(grub_stream);
+	grub_stream = NULL;
+	
+	if (EFI_ERROR(err) || !IsRunnableImage(core_files.grub_image, size)) {
+		if (core_files.grub_image) {
+			FreePool(core_files.grub_image);
+		}
+		core_files.grub_image = NULL;
+		return;
+	}
+	
+	core_files.grub_image_size = size;
+}
+
+static VOID ValidateCoreFilesLocked(VOID) {
+	if (core_files.checked) {
+		return;
+	}
+	
+	// GRUB was read and checked by FinishGRUBPreload.
+	core_files.grub_found = core_files.grub_image != NULL;
+	
+	// Check if there is a persistence file present.
+	// TODO: Support distributions other than Ubuntu.
+	core_files.persistence_found = FileExists(validation_root, L"\\casper-rw");
+	if (core_files.persistence_found) {
+		preset_options_array[4] = TRUE;
+	}
+	
+	core_files.checked = TRUE;
+}
+
+static EntryValidationState ValidateEntryLocked(LinuxBootOption *option) {
+	if (option->validation == ENTRY_UNCHECKED) {
+		EFI_FILE_HANDLE root = option->volume ? option->volume->root : validation_root;
+		CHAR16 *temp = GRUBPathToEFIPath(option->iso_path);
+		EFI_FILE_INFO info;
+		EFI_STATUS err = FileCacheGetInfo(root, temp, &info);
+		
+		option->validation = EFI_ERROR(err) ? ENTRY_ISO_MISSING : ENTRY_VALID;
+		option->iso_size = EFI_ERROR(err) ? 0 : info.FileSize;
+		FreePool(temp);
+	}
+	
+	return option->validation;
+}
+
+/* Runs at TPL_CALLBACK on every timer tick and does a single check. */
+static VOID EFIAPI ValidationTick(EFI_EVENT event, VOID *context) {
+	(void)event;
+	(void)context;
+	
+	if (!core_files.checked) {
+		ValidateCoreFilesLocked();
+		uefi_call_wrapper(BS->SignalEvent, 1, validation_event);
+		return;
+	}
+	
+	// Skip over entries that were already validated in the foreground.
+	while (next_entry && next_entry->bootOption->validation != ENTRY_UNCHECKED) {
+		next_entry = next_entry->next;
+	}
+	
+	if (!next_entry) {
+		uefi_call_wrapper(BS->SetTimer, 3, timer_event, TimerCancel, 0);
+		return;
+	}
+	
+	if (ValidateEntryLocked(next_entry->bootOption) != ENTRY_VALID) {
+		uefi_call_wrapper(BS->SignalEvent, 1, validation_event);
+	}
+	next_entry = next_entry->next;
+}
+
+VOID StartBackgroundValidation(EFI_FILE_HANDLE root) {
+	EFI_STATUS err;
+	
+	validation_root = root;
+	next_entry = distributionListRoot ? distributionListRoot->next : NULL;
+	
+	err = uefi_call_wrapper(BS->CreateEvent, 5, 0, 0, NULL, NULL, &validation_event);
+	if (EFI_ERROR(err)) {
+		validation_event = NULL;
+		return;
+	}
+	
+	err = uefi_call_wrapper(BS->CreateEvent, 5, EVT_TIMER|EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+		ValidationTick, NULL, &timer_event);
+	if (!EFI_ERROR(err)) {
+		// A period of zero fires the event on every timer tick.
+		err = uefi_call_wrapper(BS->SetTimer, 3, timer_event, TimerPeriodic, 0);
+	}
+	
+	// Without a timer everything is simply validated on demand.
+	if (EFI_ERROR(err) && timer_event) {
+		uefi_call_wrapper(BS->CloseEvent, 1, timer_event);
+		timer_event = NULL;
+	}
+}
+
+VOID StopBackgroundValidation(VOID) {
+	if (timer_event) {
+		uefi_call_wrapper(BS->SetTimer, 3, timer_event, TimerCancel, 0);
+		uefi_call_wrapper(BS->CloseEvent, 1, timer_event);
+		timer_event = NULL;
+	}
+	
+	if (validation_event) {
+		uefi_call_wrapper(BS->CloseEvent, 1, validation_event);
+		validation_event = NULL;
+	}
+}
+
+/*
+ * Finishes the checks of the files that every boot needs, if the background checks
+ * haven't got to them yet. Raising the TPL keeps the timer from running in between.
+ */
+VOID ValidateCoreFiles(VOID) {
+	EFI_TPL old_tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	ValidateCoreFilesLocked();
+	uefi_call_wrapper(BS->RestoreTPL, 1, old_tpl);
+}
+
+EntryValidationState ValidateEntry(LinuxBootOption *option) {
+	EntryValidationState state;
+	EFI_TPL old_tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	
+	state = ValidateEntryLocked(option);
+	uefi_call_wrapper(BS->RestoreTPL, 1, old_tpl);
+	return state;
+}
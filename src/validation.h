@@ -0,0 +1,46 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _validation_h
+#define _validation_h
+#include "main.h"
+
+/* The state of the files that every boot needs, filled in by the background checks. */
+typedef struct CoreFileState {
+	BOOLEAN checked;
+	BOOLEAN grub_found;
+	BOOLEAN persistence_found;
+	VOID *grub_image; // GRUB's image, read into memory by StartGRUBPreload.
+	UINTN grub_image_size;
+} CoreFileState;
+
+extern CoreFileState core_files;
+extern EFI_EVENT validation_event;
+
+#define GRUB_IMAGE_PATH L"\\efi\\boot\\boot.efi"
+
+VOID StartGRUBPreload(EFI_FILE_HANDLE, EFI_HANDLE);
+VOID FinishGRUBPreload(VOID);
+VOID StartBackgroundValidation(EFI_FILE_HANDLE);
+VOID StopBackgroundValidation(VOID);
+VOID ValidateCoreFiles(VOID);
+EntryValidationState ValidateEntry(LinuxBootOption *);
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "variables.h"
+
+typedef struct CachedVariable {
+	EFI_GUID vendor;
+	CHAR16 *name;
+	CHAR8 *data; // NULL if the variable doesn't exist.
+	UINTN size;
+	BOOLEAN persistent;
+	BOOLEAN dirty; // Changed, but not written to the firmware yet.
+	struct CachedVariable *next;
+} CachedVariable;
+
+static CachedVariable *cached_variables = NULL;
+
+static CachedVariable* FindCachedVariable(const EFI_GUID * const vendor, CHAR16 *name) {
+	CachedVariable *variable;
+	
+	for (variable = cached_variables; variable; variable = variable->next) {
+		if (CompareMem(&variable->vendor, (VOID *)vendor, sizeof(EFI_GUID)) == 0 &&
+			StrCmp(variable->name, name) == 0) {
+			return variable;
+		}
+	}
+	
+	return NULL;
+}
+
+/* Returns the cache entry of a variable, reading it from the firmware the first time. */
+static CachedVariable* LookupVariable(const EFI_GUID * const vendor, CHAR16 *name) {
+	CachedVariable *variable = FindCachedVariable(vendor, name);
+	UINT32 attributes;
+	
+	if (variable) {
+		return variable;
+	}
+	
+	variable = AllocateZeroPool(sizeof(CachedVariable));
+	if (!variable) {
+		return NULL;
+	}
+	
+	variable->name = StrDuplicate(name);
+	if (!variable->name) {
+		FreePool(variable);
+		return NULL;
+	}
+	CopyMem(&variable->vendor, (VOID *)vendor, sizeof(EFI_GUID));
+	
+	// Variables that don't exist are remembered as well. For the ones that do, whether
+	// they are non-volatile has to be known so that unchanged writes can be dropped.
+	if (EFI_ERROR(efi_get_variable(vendor, name, &variable->data, &variable->size, &attributes))) {
+		variable->data = NULL;
+		variable->size = 0;
+	} else {
+		variable->persistent = (attributes & EFI_VARIABLE_NON_VOLATILE) != 0;
+	}
+	
+	variable->next = cached_variables;
+	cached_variables = variable;
+	return variable;
+}
+
+/*
+ * Returns the contents of a variable. The buffer belongs to the cache and stays valid
+ * until the variable is changed.
+ */
+EFI_STATUS VariableGet(const EFI_GUID * const vendor, CHAR16 *name, OUT CHAR8 **buffer, OUT UINTN *size) {
+	CachedVariable *variable = LookupVariable(vendor, name);
+	
+	if (!variable) {
+		return efi_get_variable(vendor, name, buffer, size, NULL);
+	}
+	if (!variable->data) {
+		return EFI_NOT_FOUND;
+	}
+	
+	*buffer = variable->data;
+	if (size) {
+		*size = variable->size;
+	}
+	return EFI_SUCCESS;
+}
+
+/*
+ * Changes a variable. Volatile variables are written straight away; non-volatile ones
+ * are written by VariableFlush. Writes that wouldn't change anything are dropped.
+ */
+EFI_STATUS VariableSet(const EFI_GUID * const vendor, CHAR16 *name, CHAR8 *buffer, UINTN size, BOOLEAN persistent) {
+	CachedVariable *variable = LookupVariable(vendor, name);
+	CHAR8 *data;
+	
+	if (!variable) {
+		return efi_set_variable(vendor, name, buffer, size, persistent);
+	}
+	
+	if (variable->data && variable->size == size && variable->persistent == persistent &&
+		CompareMem(variable->data, buffer, size) == 0) {
+		return EFI_SUCCESS;
+	}
+	
+	data = AllocatePool(size ? size : 1);
+	if (!data) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	CopyMem(data, buffer, size);
+	
+	if (variable->data) {
+		FreePool(variable->data);
+	}
+	variable->data = data;
+	variable->size = size;
+	variable->persistent = persistent;
+	
+	if (!persistent) {
+		variable->dirty = FALSE;
+		return efi_set_variable(vendor, name, buffer, size, FALSE);
+	}
+	
+	variable->dirty = TRUE;
+	return EFI_SUCCESS;
+}
+
+/* Deletes a variable. Like any change, this is held back until VariableFlush. */
+EFI_STATUS VariableDelete(const EFI_GUID * const vendor, CHAR16 *name) {
+	CachedVariable *variable = LookupVariable(vendor, name);
+	
+	if (!variable) {
+		return efi_delete_variable(vendor, name);
+	}
+	if (!variable->data) {
+		return EFI_SUCCESS;
+	}
+	
+	FreePool(variable->data);
+	variable->data = NULL;
+	variable->size = 0;
+	variable->dirty = TRUE;
+	return EFI_SUCCESS;
+}
+
+/* Writes every held back change to the firmware. */
+VOID VariableFlush(VOID) {
+	CachedVariable *variable;
+	
+	for (variable = cached_variables; variable; variable = variable->next) {
+		if (!variable->dirty) {
+			continue;
+		}
+		
+		if (variable->data) {
+			efi_set_variable(&variable->vendor, variable->name, variable->data, variable->size, variable->persistent);
+		} else {
+			efi_delete_variable(&variable->vendor, variable->name);
+		}
+		variable->dirty = FALSE;
+	}
+}
@@ -0,0 +1,36 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _variables_h
+#define _variables_h
+#include "main.h"
+
+/*
+ * A cache on top of the efi_*_variable helpers. Every variable is read from the firmware
+ * at most once per boot, and writes to non-volatile variables are held back until
+ * VariableFlush, so that a variable changed several times is written to flash only
+ * once. VariableFlush has to be called before handing control to another image.
+ */
+EFI_STATUS VariableGet(const EFI_GUID * const, CHAR16 *, OUT CHAR8 **, OUT UINTN *);
+EFI_STATUS VariableSet(const EFI_GUID * const, CHAR16 *, CHAR8 *, UINTN, BOOLEAN);
+EFI_STATUS VariableDelete(const EFI_GUID * const, CHAR16 *);
+VOID VariableFlush(VOID);
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "utils.h"
+#include "volumes.h"
+
+/*
+ * Finds every volume with a file system the firmware understands. The volume we were
+ * loaded from always comes first so that its entries are listed first.
+ */
+UINTN LocateVolumes(EFI_HANDLE boot_device, OUT Volume **out) {
+	EFI_HANDLE *handles = NULL;
+	UINTN handle_count = 0, count = 0, i;
+	EFI_STATUS err;
+	Volume *volumes;
+	
+	*out = NULL;
+	err = LibLocateHandle(ByProtocol, &FileSystemProtocol, NULL, &handle_count, &handles);
+	if (EFI_ERROR(err) || handle_count == 0) {
+		return 0;
+	}
+	
+	volumes = AllocateZeroPool(sizeof(Volume) * handle_count);
+	if (!volumes) {
+		FreePool(handles);
+		return 0;
+	}
+	
+	for (i = 0; i < handle_count; i++) {
+		EFI_FILE_HANDLE root = LibOpenRoot(handles[i]);
+		if (!root) {
+			continue;
+		}
+		
+		Volume *volume = &volumes[count++];
+		volume->device = handles[i];
+		volume->root = root;
+		volume->device_path = DevicePathToStr(DevicePathFromHandle(handles[i]));
+		volume->is_boot_volume = handles[i] == boot_device;
+		
+		// Swap the boot volume into the first position.
+		if (volume->is_boot_volume && volume != &volumes[0]) {
+			Volume temp = volumes[0];
+			volumes[0] = *volume;
+			*volume = temp;
+		}
+	}
+	
+	FreePool(handles);
+	*out = volumes;
+	return count;
+}
+
+/*
+ * Closes the volumes returned by LocateVolumes before they were put to any use, and frees
+ * the array.
+ */
+VOID FreeVolumes(Volume *volumes, UINTN count) {
+	UINTN i;
+	
+	for (i = 0; i < count; i++) {
+		uefi_call_wrapper(volumes[i].root->Close, 1, volumes[i].root);
+		if (volumes[i].device_path) {
+			FreePool(volumes[i].device_path);
+		}
+	}
+	if (volumes) {
+		FreePool(volumes);
+	}
+}
+
+/*
+ * Starts reading a configuration file from the volume without waiting for the read to
+ * complete, so that the files on all volumes can be read at the same time.
+ */
+VOID StartConfigurationRead(Volume *volume, const CHAR16 * const name) {
+	EFI_STATUS err;
+	
+	err = FileStreamOpen(volume->root, name, volume->device, 64 * 1024, &volume->config_stream);
+	if (EFI_ERROR(err)) {
+		volume->config_stream = NULL;
+		return;
+	}
+	
+	err = FileStreamStart(volume->config_stream);
+	if (EFI_ERROR(err)) {
+		FileStreamClose(volume->config_stream);
+		volume->config_stream = NULL;
+	}
+}
+
+/*
+ * Waits for the configuration file read by StartConfigurationRead and returns its
+ * contents as a null-terminated string, or NULL if the volume doesn't have one.
+ */
+CHAR8* FinishConfigurationRead(Volume *volume) {
+	FileStream *stream = volume->config_stream;
+	CHAR8 *contents, *chunk;
+	UINTN size, length, position = 0;
+	EFI_STATUS err;
+	
+	if (!stream) {
+		return NULL;
+	}
+	volume->config_stream = NULL;
+	
+	size = (UINTN)FileStreamSize(stream);
+	contents = AllocatePool(size + 1);
+	if (!contents) {
+		FileStreamClose(stream);
+		return NULL;
+	}
+	
+	for (;;) {
+		err = FileStreamNextChunk(stream, &chunk, &length);
+		if (EFI_ERROR(err) || length == 0 || position + length > size) {
+			break;
+		}
+		
+		CopyMem(contents + position, chunk, length);
+		position += length;
+	}
+	FileStreamClose(stream);
+	
+	if (EFI_ERROR(err) || position == 0) {
+		FreePool(contents);
+		return NULL;
+	}
+	
+	contents[position] = '\0';
+	return contents;
+}
+
+/* Returns TRUE if the file name ends in .iso, ignoring case. */
+static BOOLEAN IsISOFileName(CHAR16 *name) {
+	UINTN length = StrLen(name);
+	
+	if (length < 5) {
+		return FALSE;
+	}
+	
+	name += length - 4;
+	return name[0] == '.' &&
+		(name[1] | 0x20) == 'i' && (name[2] | 0x20) == 's' && (name[3] | 0x20) == 'o';
+}
+
+/*
+ * Lists the ISO files in the well-known ISO directory of the volume. Returns the number
+ * of files found; the names and the array holding them must be freed by the caller.
+ */
+UINTN ListISOFiles(Volume *volume, OUT CHAR16 ***out) {
+	EFI_FILE_HANDLE dir;
+	UINTN info_size = SIZE_OF_EFI_FILE_INFO + 256 * sizeof(CHAR16);
+	EFI_FILE_INFO *info;
+	CHAR16 **names = NULL, **grown;
+	UINTN count = 0, capacity = 0;
+	EFI_STATUS err;
+	
+	*out = NULL;
+	err = uefi_call_wrapper(volume->root->Open, 5, volume->root, &dir, ISO_DIRECTORY, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(err)) {
+		return 0;
+	}
+	
+	info = AllocatePool(info_size);
+	if (!info) {
+		uefi_call_wrapper(dir->Close, 1, dir);
+		return 0;
+	}
+	
+	for (;;) {
+		UINTN size = info_size;
+		err = uefi_call_wrapper(dir->Read, 3, dir, &size, info);
+		
+		// Long file names need a bigger buffer; the firmware says how big.
+		if (err == EFI_BUFFER_TOO_SMALL) {
+			FreePool(info);
+			info_size = size;
+			info = AllocatePool(info_size);
+			if (!info) {
+				break;
+			}
+			continue;
+		}
+		if (EFI_ERROR(err) || size == 0) {
+			break;
+		}
+		
+		if ((info->Attribute & EFI_FILE_DIRECTORY) || !IsISOFileName(info->FileName)) {
+			continue;
+		}
+		
+		if (count == capacity) {
+			UINTN new_capacity = capacity ? capacity * 2 : 8;
+			grown = AllocatePool(new_capacity * sizeof(CHAR16 *));
+			if (!grown) {
+				// Don't hand back a listing that silently misses files.
+				while (count > 0) {
+					FreePool(names[--count]);
+				}
+				break;
+			}
+			if (names) {
+				CopyMem(grown, names, count * sizeof(CHAR16 *));
+				FreePool(names);
+			}
+			names = grown;
+			capacity = new_capacity;
+		}
+		
+		names[count] = StrDuplicate(info->FileName);
+		if (names[count]) {
+			count++;
+		}
+	}
+	
+	if (count == 0 && names) {
+		FreePool(names);
+		names = NULL;
+	}
+	if (info) {
+		FreePool(info);
+	}
+	uefi_call_wrapper(dir->Close, 1, dir);
+	*out = names;
+	return count;
+}
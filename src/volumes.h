@@ -0,0 +1,48 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2013 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _volumes_h
+#define _volumes_h
+#include "main.h"
+#include "utils.h"
+
+/* The directory searched for ISO files on every volume. */
+#define ISO_DIRECTORY L"\\isos"
+
+/* A file system that boot entries can come from. */
+typedef struct Volume {
+	EFI_HANDLE device;
+	EFI_FILE_HANDLE root;
+	CHAR16 *device_path;
+	BOOLEAN is_boot_volume;
+	FileStream *config_stream;
+	CHAR16 **iso_files;
+	UINTN iso_file_count;
+	BOOLEAN catalog_loaded;
+	struct CatalogEntry **catalog;
+} Volume;
+
+UINTN LocateVolumes(EFI_HANDLE, OUT Volume **);
+VOID FreeVolumes(Volume *, UINTN);
+VOID StartConfigurationRead(Volume *, const CHAR16 const *);
+CHAR8* FinishConfigurationRead(Volume *);
+UINTN ListISOFiles(Volume *, OUT CHAR16 ***);
+
+#endif